@@ -0,0 +1,416 @@
+/*
+ WarPlan benchmarks.
+
+ Builds the WarPlan sources with their own entry point swapped out and times the hot paths one at
+ a time: single dice and roll draws, single attacks, whole territory battles, predictions for
+ every engine at several army sizes, and end to end planning sweeps over attack vector count and
+ bonus units.
+
+ Every benchmark doubles its operation count until a run takes at least the requested number of
+ seconds, 0.25 by default, and reports that run as one CSV row:
+
+     benchmark,engine,size,unit,operations,seconds,ns_per_operation,operations_per_second
+
+ Rows are always printed in the same order with a fixed seed on a single thread, so runs of
+ different builds can be diffed or joined directly.
+
+ Usage:
+     ./warplan-bench [minimum seconds per benchmark]
+ */
+
+
+#define main WarPlanMain
+#include "main.c"
+#undef main
+
+
+#define BENCH_DEFAULT_SECONDS   0.25
+#define BENCH_MEMO_MEGABYTES    64
+#define BENCH_PLAN_ITERATIONS   1000
+#define BENCH_PLAN_THRESHOLD    0.8f
+#define BENCH_SIZE_STRING_SIZE  64
+
+/* The default ruleset as its kernels see it, every rule a constant */
+#define BENCH_RULES RULESET_RULES(3, 2, 6, 1)
+
+
+typedef void (*bench_function)(void* context, uint64_t operation_count);
+
+struct battle_bench
+{
+    unsigned int units_on_front;
+    unsigned int territory_units;
+};
+
+struct prediction_bench
+{
+    struct attack_vector_def attack_vector;
+};
+
+struct plan_bench
+{
+    struct attack_vector_def* attack_vectors;
+    size_t                    attack_vector_count;
+    unsigned int              bonus_units;
+    FILE*                     result_stream;
+};
+
+
+static double            bench_min_seconds;
+static volatile uint64_t bench_sink;
+
+static char* bench_vector_strings[] =
+{
+    "5:3,2",
+    "20:10,5,5",
+    "100:40,30,20,10"
+};
+
+static char* bench_plan_vector_strings[] =
+{
+    "6:3,2,1",
+    "4:1,1,1,1",
+    "9:5,2",
+    "3:2,2",
+    "12:4,4,4",
+    "7:6",
+    "5:1,3,1",
+    "8:2,2,2,2"
+};
+
+static unsigned int bench_plan_vector_counts[] = {2, 4, 8};
+static unsigned int bench_plan_bonus_units[]   = {5, 20, 50};
+
+
+static inline void
+RunBenchmark (
+              char*              name,
+              char*              engine,
+              char*              size,
+              char*              unit,
+              enum program_flags flags,
+              bench_function     function,
+              void*              context
+             )
+{
+    enum program_flags saved_flags;
+    uint64_t           operation_count;
+    double             seconds;
+
+    saved_flags  = run_flags;
+    run_flags   |= flags;
+    run_seed     = MixSeed(0);
+
+    SeedSimContext(&run_pool.workers[0].sim, 0, 0);
+
+    for(operation_count = 1;; operation_count *= 2)
+    {
+        double start;
+
+        start = MonotonicSeconds();
+        function(context, operation_count);
+        seconds = MonotonicSeconds()-start;
+
+        if(seconds >= bench_min_seconds)
+            break;
+    }
+
+    run_flags = saved_flags;
+
+    printf(
+           "%s,%s,\"%s\",%s,%llu,%.6f,%.3f,%.1f\n",
+           name,
+           engine,
+           size,
+           unit,
+           (unsigned long long)operation_count,
+           seconds,
+           seconds*1e9/(double)operation_count,
+           (double)operation_count/seconds
+          );
+    fflush(stdout);
+}
+
+static void
+BenchUniformDiceRoll (void* context, uint64_t operation_count)
+{
+    struct sim_context* sim;
+    uint64_t            sum;
+
+    sim = &run_pool.workers[0].sim;
+    sum = 0;
+
+    for(uint64_t index = 0; index < operation_count; index++)
+        sum += UniformDiceRoll(sim, BENCH_RULES);
+
+    bench_sink = sum;
+}
+
+static void
+BenchRollDice (void* context, uint64_t operation_count)
+{
+    struct sim_context* sim;
+    unsigned int        dice[MAX_DICE_COUNT];
+    uint64_t            sum;
+
+    sim = &run_pool.workers[0].sim;
+    sum = 0;
+
+    for(uint64_t index = 0; index < operation_count; index++)
+    {
+        RollDice(sim, BENCH_RULES, dice, MAX_DICE_COUNT);
+        sum += dice[0];
+    }
+
+    bench_sink = sum;
+}
+
+static void
+BenchSingleAttack (void* context, uint64_t operation_count)
+{
+    struct battle_bench* battle;
+    struct sim_context*  sim;
+    uint64_t             sum;
+
+    battle = context;
+    sim    = &run_pool.workers[0].sim;
+    sum    = 0;
+
+    for(uint64_t index = 0; index < operation_count; index++)
+    {
+        unsigned int front_units;
+        unsigned int territory_units;
+
+        SingleAttack(sim, BENCH_RULES, battle->units_on_front, battle->territory_units, &front_units, &territory_units);
+        sum += front_units;
+    }
+
+    bench_sink = sum;
+}
+
+static void
+BenchSingleAttackSampled (void* context, uint64_t operation_count)
+{
+    struct battle_bench* battle;
+    struct sim_context*  sim;
+    uint64_t             sum;
+
+    battle = context;
+    sim    = &run_pool.workers[0].sim;
+    sum    = 0;
+
+    for(uint64_t index = 0; index < operation_count; index++)
+    {
+        unsigned int front_units;
+        unsigned int territory_units;
+
+        SingleAttackSampled(sim, BENCH_RULES, battle->units_on_front, battle->territory_units, &front_units, &territory_units);
+        sum += front_units;
+    }
+
+    bench_sink = sum;
+}
+
+static void
+BenchAttackTerritory (void* context, uint64_t operation_count)
+{
+    struct battle_bench* battle;
+    struct sim_context*  sim;
+    struct territory_def territory;
+    uint64_t             sum;
+
+    battle = context;
+    sim    = &run_pool.workers[0].sim;
+    sum    = 0;
+
+    territory.units = battle->territory_units;
+
+    for(uint64_t index = 0; index < operation_count; index++)
+    {
+        unsigned int front_units;
+        unsigned int territory_units;
+
+        AttackTerritory(sim, BENCH_RULES, battle->units_on_front, &territory, &front_units, &territory_units);
+        sum += front_units;
+    }
+
+    bench_sink = sum;
+}
+
+static void
+BenchPredictAttack (void* context, uint64_t operation_count)
+{
+    struct prediction_bench* bench;
+    struct prediction_cell   cell;
+    struct attack_prediction prediction;
+
+    bench = context;
+
+    cell.attack_vector = &bench->attack_vector;
+    cell.bonus_units   = 0;
+    cell.prediction    = &prediction;
+
+    /* The exact engine ignores iterations, so each operation is a whole prediction */
+    if(run_flags&enable_exact_engine)
+    {
+        for(uint64_t index = 0; index < operation_count; index++)
+            PredictAttacks(&cell, 1, 0, NO_LIKELIHOOD_THRESHOLD);
+    }
+    else
+        PredictAttacks(&cell, 1, operation_count, NO_LIKELIHOOD_THRESHOLD);
+
+    bench_sink = (uint64_t)(prediction.win_likelihood*1e6f);
+}
+
+static void
+BenchPlanWar (void* context, uint64_t operation_count)
+{
+    struct plan_bench* bench;
+
+    bench = context;
+
+    for(uint64_t index = 0; index < operation_count; index++)
+    {
+        PlanWar(
+                bench->attack_vectors,
+                bench->attack_vector_count,
+                bench->bonus_units,
+                BENCH_PLAN_THRESHOLD,
+                BENCH_PLAN_ITERATIONS,
+                bench->result_stream
+               );
+    }
+}
+
+static inline void
+BenchBattles (void)
+{
+    struct battle_bench battles[] = {{5, 3}, {20, 15}, {100, 80}};
+    char                size[BENCH_SIZE_STRING_SIZE];
+    struct battle_bench single_attack;
+
+    single_attack.units_on_front  = 10;
+    single_attack.territory_units = 10;
+
+    snprintf(size, sizeof(size), "%uv%u", single_attack.units_on_front, single_attack.territory_units);
+
+    RunBenchmark("single_attack", "dice", size, "attack", 0, &BenchSingleAttack, &single_attack);
+    RunBenchmark("single_attack", "sampled", size, "attack", 0, &BenchSingleAttackSampled, &single_attack);
+
+    for(size_t index = 0; index < sizeof(battles)/sizeof(battles[0]); index++)
+    {
+        struct battle_bench* battle;
+
+        battle = &battles[index];
+
+        snprintf(size, sizeof(size), "%uv%u", battle->units_on_front, battle->territory_units);
+
+        RunBenchmark("attack_territory", "dice", size, "battle", enable_dice_rolls, &BenchAttackTerritory, battle);
+        RunBenchmark("attack_territory", "sampled", size, "battle", 0, &BenchAttackTerritory, battle);
+        RunBenchmark("attack_territory", "memo", size, "battle", enable_battle_memo, &BenchAttackTerritory, battle);
+    }
+}
+
+static inline void
+BenchPredictions (void)
+{
+    struct prediction_bench bench;
+
+    for(size_t index = 0; index < sizeof(bench_vector_strings)/sizeof(bench_vector_strings[0]); index++)
+    {
+        char* size;
+
+        size = bench_vector_strings[index];
+
+        if(ParseAttackVector(&run_arena, size, &bench.attack_vector) != NULL)
+            Abort("Malformed benchmark attack vector");
+
+        RunBenchmark("predict_attack", "exact", size, "prediction", enable_exact_engine, &BenchPredictAttack, &bench);
+        RunBenchmark("predict_attack", "batch", size, "trial", 0, &BenchPredictAttack, &bench);
+        RunBenchmark("predict_attack", "scalar", size, "trial", enable_scalar_trials, &BenchPredictAttack, &bench);
+        RunBenchmark("predict_attack", "dice", size, "trial", enable_dice_rolls, &BenchPredictAttack, &bench);
+        RunBenchmark("predict_attack", "memo", size, "trial", enable_battle_memo, &BenchPredictAttack, &bench);
+    }
+}
+
+static inline void
+BenchPlans (void)
+{
+    struct attack_vector_def* attack_vectors;
+    struct plan_bench         bench;
+    size_t                    vector_string_count;
+
+    vector_string_count = sizeof(bench_plan_vector_strings)/sizeof(bench_plan_vector_strings[0]);
+    attack_vectors      = ArenaAlloc(&run_arena, vector_string_count*sizeof(struct attack_vector_def));
+
+    for(size_t index = 0; index < vector_string_count; index++)
+    {
+        if(ParseAttackVector(&run_arena, bench_plan_vector_strings[index], &attack_vectors[index]) != NULL)
+            Abort("Malformed benchmark attack vector");
+    }
+
+    bench.attack_vectors = attack_vectors;
+    bench.result_stream  = fopen("/dev/null", "w");
+    if(bench.result_stream == NULL)
+        Abort("Failed to open /dev/null");
+
+    for(size_t count_index = 0; count_index < sizeof(bench_plan_vector_counts)/sizeof(bench_plan_vector_counts[0]); count_index++)
+    {
+        for(size_t bonus_index = 0; bonus_index < sizeof(bench_plan_bonus_units)/sizeof(bench_plan_bonus_units[0]); bonus_index++)
+        {
+            char size[BENCH_SIZE_STRING_SIZE];
+
+            bench.attack_vector_count = bench_plan_vector_counts[count_index];
+            bench.bonus_units         = bench_plan_bonus_units[bonus_index];
+
+            snprintf(size, sizeof(size), "%zux%u", bench.attack_vector_count, bench.bonus_units);
+
+            RunBenchmark("plan_war", "exact", size, "plan", enable_exact_engine, &BenchPlanWar, &bench);
+            RunBenchmark("plan_war", "batch", size, "plan", 0, &BenchPlanWar, &bench);
+            RunBenchmark("plan_war", "monotone", size, "plan", enable_monotone, &BenchPlanWar, &bench);
+        }
+    }
+
+    fclose(bench.result_stream);
+}
+
+int
+main (int arg_count, char** args)
+{
+    bench_min_seconds = BENCH_DEFAULT_SECONDS;
+    if(arg_count > 1)
+        bench_min_seconds = atof(args[1]);
+
+    if(bench_min_seconds <= 0)
+        Abort("Benchmark seconds must be positive");
+
+    run_flags        = 0;
+    run_seed         = MixSeed(0);
+    run_thread_count = 1;
+    run_top_plans    = 1;
+    run_precision    = 0;
+    run_confidence   = DEFAULT_CONFIDENCE;
+    run_confidence_z = ConfidenceZScore(run_confidence);
+    run_serve_socket = NULL;
+
+    SelectRuleset(DEFAULT_DICE_RULES);
+    InitRollOutcomes();
+    InitThreadPool(&run_pool, run_thread_count);
+    InitArena(&run_arena);
+    InitBattleMemo(&run_memo, (size_t)BENCH_MEMO_MEGABYTES*1024*1024);
+
+    printf("benchmark,engine,size,unit,operations,seconds,ns_per_operation,operations_per_second\n");
+
+    RunBenchmark("uniform_dice_roll", "rng", "1", "roll", 0, &BenchUniformDiceRoll, NULL);
+    RunBenchmark("roll_dice", "rng", "3", "roll", 0, &BenchRollDice, NULL);
+
+    BenchBattles();
+    BenchPredictions();
+    BenchPlans();
+
+    DestroyBattleMemo(&run_memo);
+    DestroyThreadPool(&run_pool);
+    FreeArena(&run_arena);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+/*
+ WarPlan battle table generator.
+
+ Builds the WarPlan sources with their own entry point swapped out and solves every battle of
+ one more than the units left behind up to [max front units] attacking 1 up to [max territory units] defenders
+ exactly, writing each one's win likelihood, expected survivors and full outcome distribution to
+ a page aligned table file that warplan maps with --table.  Battles follow the dice rules given,
+ the default ones otherwise, and warplan only maps a table under the --rules it was built for.
+
+ Usage:
+     ./warplan-gentable [max front units] [max territory units] [table file] [dice rules]
+ */
+
+
+#define main WarPlanMain
+#include "main.c"
+#undef main
+
+
+static inline uint64_t
+AlignTableOffset (uint64_t offset)
+{
+    return (offset+BATTLE_TABLE_ALIGNMENT-1)&~(uint64_t)(BATTLE_TABLE_ALIGNMENT-1);
+}
+
+static inline void
+WriteTablePadding (FILE* table_file, uint64_t offset)
+{
+    static char padding[BATTLE_TABLE_ALIGNMENT];
+
+    if(fwrite(padding, 1, AlignTableOffset(offset)-offset, table_file) != AlignTableOffset(offset)-offset)
+        Abort("Failed to write battle table");
+}
+
+int
+main (int arg_count, char** args)
+{
+    struct battle_table_header header;
+    struct battle_table_entry* entries;
+    FILE*                      table_file;
+    double*                    front_likelihoods;
+    double*                    scratch_rows;
+    double*                    likelihoods;
+    unsigned int               max_front_units;
+    unsigned int               max_territory_units;
+    size_t                     entry_count;
+    uint64_t                   likelihood_size;
+
+    if(arg_count != 4 && arg_count != 5)
+    {
+        printf("Usage: warplan-gentable [max front units] [max territory units] [table file] [dice rules]\n");
+
+        return EXIT_FAILURE;
+    }
+
+    SelectRuleset(arg_count == 5 ? args[4] : DEFAULT_DICE_RULES);
+
+    max_front_units     = (unsigned int)strtoul(args[1], NULL, 10);
+    max_territory_units = (unsigned int)strtoul(args[2], NULL, 10);
+    if(max_front_units <= run_rules.min_territory_units || max_territory_units == 0)
+        Abort("The table needs at least one front size able to attack and one defender");
+
+    InitRollOutcomes();
+
+    entry_count = (size_t)(max_front_units-run_rules.min_territory_units)*max_territory_units;
+
+    entries           = malloc(entry_count*sizeof(struct battle_table_entry));
+    front_likelihoods = malloc((max_front_units+1)*sizeof(double));
+    scratch_rows      = malloc(EXACT_ROW_COUNT*(max_front_units+1)*sizeof(double));
+    likelihoods       = malloc((max_front_units+max_territory_units+1)*sizeof(double));
+    if(entries == NULL || front_likelihoods == NULL || scratch_rows == NULL || likelihoods == NULL)
+        Abort("Failed to alloc memory for battle table");
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BATTLE_TABLE_MAGIC, sizeof(header.magic));
+
+    header.version             = BATTLE_TABLE_VERSION;
+    header.rules               = run_rules;
+    header.max_front_units     = max_front_units;
+    header.max_territory_units = max_territory_units;
+    header.entry_count         = (uint32_t)entry_count;
+    header.entry_offset        = AlignTableOffset(sizeof(header));
+    header.likelihood_offset   = AlignTableOffset(header.entry_offset+entry_count*sizeof(struct battle_table_entry));
+
+    /* Every entry's offset is known up front, so the file is written in one sequential pass */
+    likelihood_size = 0;
+
+    for(unsigned int front_units = run_rules.min_territory_units+1; front_units <= max_front_units; front_units++)
+    {
+        for(unsigned int territory_units = 1; territory_units <= max_territory_units; territory_units++)
+        {
+            struct battle_table_entry* entry;
+
+            entry = &entries[(size_t)(front_units-run_rules.min_territory_units-1)*max_territory_units+territory_units-1];
+
+            entry->likelihood_offset  = header.likelihood_offset+likelihood_size;
+            likelihood_size          += (front_units-run_rules.min_territory_units+territory_units)*sizeof(double);
+        }
+    }
+
+    header.file_size = header.likelihood_offset+likelihood_size;
+
+    table_file = fopen(args[3], "wb");
+    if(table_file == NULL)
+        Abort("Failed to open battle table file");
+
+    if(fwrite(&header, sizeof(header), 1, table_file) != 1)
+        Abort("Failed to write battle table");
+
+    WriteTablePadding(table_file, sizeof(header));
+
+    /* Entries are filled in while the likelihoods are written and then written over their placeholder */
+    if(fwrite(entries, sizeof(struct battle_table_entry), entry_count, table_file) != entry_count)
+        Abort("Failed to write battle table");
+
+    WriteTablePadding(table_file, header.entry_offset+entry_count*sizeof(struct battle_table_entry));
+
+    for(unsigned int front_units = run_rules.min_territory_units+1; front_units <= max_front_units; front_units++)
+    {
+        for(unsigned int territory_units = 1; territory_units <= max_territory_units; territory_units++)
+        {
+            struct battle_table_entry* entry;
+            unsigned int               win_outcome_count;
+            unsigned int               outcome_count;
+            double                     units_if_win;
+            double                     defenders_if_loss;
+
+            entry = &entries[(size_t)(front_units-run_rules.min_territory_units-1)*max_territory_units+territory_units-1];
+
+            win_outcome_count = front_units-run_rules.min_territory_units;
+            outcome_count     = win_outcome_count+territory_units;
+
+            entry->win_likelihood = ResolveBattleLikelihoods(
+                                                             front_units,
+                                                             territory_units,
+                                                             front_likelihoods,
+                                                             scratch_rows,
+                                                             likelihoods
+                                                            );
+
+            units_if_win      = 0;
+            defenders_if_loss = 0;
+
+            for(unsigned int index = 0; index < win_outcome_count; index++)
+                units_if_win += likelihoods[index]*(run_rules.min_territory_units+1+index);
+
+            for(unsigned int index = win_outcome_count; index < outcome_count; index++)
+                defenders_if_loss += likelihoods[index]*(index-win_outcome_count+1);
+
+            entry->units_if_win      = entry->win_likelihood > 0 ? units_if_win/entry->win_likelihood : 0;
+            entry->defenders_if_loss = entry->win_likelihood < 1 ? defenders_if_loss/(1-entry->win_likelihood) : 0;
+
+            if(fwrite(likelihoods, sizeof(double), outcome_count, table_file) != outcome_count)
+                Abort("Failed to write battle table");
+        }
+    }
+
+    if(
+       fseek(table_file, (long)header.entry_offset, SEEK_SET) != 0 ||
+       fwrite(entries, sizeof(struct battle_table_entry), entry_count, table_file) != entry_count ||
+       fclose(table_file) != 0
+      )
+        Abort("Failed to write battle table");
+
+    printf(
+           "Wrote %zu battles, up to %u front units against %u defenders, %llu bytes\n",
+           entry_count,
+           max_front_units,
+           max_territory_units,
+           (unsigned long long)header.file_size
+          );
+
+    free(likelihoods);
+    free(scratch_rows);
+    free(front_likelihoods);
+    free(entries);
+
+    return EXIT_SUCCESS;
+}
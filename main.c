@@ -19,6 +19,138 @@
 
  Your attack vector would then be written: 10:3,2,99
 
+ An attack vector may also fork.  Bracketed branches after the last territory are themselves
+ territory sequences, each attacked from that territory.  The survivors, less the units left to
+ hold it, are split across the branches in proportion to the enemy units each has to beat, and
+ the vector is only won when every branch is.  Taking York and then both Oxford, then London, and
+ Leeds, holding 4, is written: 10:3[2,99][4].  Branches nest, and a vector may fork straight from
+ the front, as in 10:[3][4].  Every shared prefix is simulated once per trial, and --exact solves
+ each subtree once for every front size it could be handed rather than once per path.
+
+ By default every prediction is estimated by simulating the attack vector the requested number of
+ times.  Passing --exact instead treats each territory battle as the absorbing Markov chain it is
+ and propagates the probability of every (front units, defending units) state through the
+ territory vector, producing exact, zero variance predictions.  The iteration count is ignored
+ in that case.
+
+ When planning, --curve predicts exactly too, but solves each vector once rather than once per
+ bonus level.  Recursing backwards from its last territory to its first over every front size
+ gives the win likelihood and expected survivors for every starting front up to the units on the
+ front plus all bonus units in a single sweep, which fills the vector's whole row of setups.  The
+ curve of every vector is printed ahead of the plans.
+
+ Dice follow WarFish's default rules unless --rules picks another ruleset: the attacker rolls
+ up to 3 dice, the defender up to 2, dice have 6 sides and 1 unit must stay behind on every
+ territory.  --rules 3v3d8l2, for instance, gives the defender 3 dice, 8 sided dice throughout
+ and leaves 2 units behind.  Each ruleset is compiled into trial kernels of its own, with its
+ rules as constants, and a run picks its kernels once rather than testing rules as it rolls.
+ Rulesets whose full roll needs more than 2^16 outcomes are simulated one trial at a time.
+
+ Simulated rolls are drawn directly from precomputed per-roll outcome tables, one random number per
+ roll.  Passing --dice rolls and compares individual dice instead.
+
+ Predictions can be spread across worker threads with --threads.  Every prediction is split into
+ fixed size chunks of iterations and each chunk draws from its own random stream, so results are
+ reproducible for a given seed no matter how many threads share the work.
+
+ With --precision, each prediction is sampled in growing batches of chunks and stops as soon as
+ the Wilson score interval of its win likelihood, at the --confidence level, is narrower than the
+ requested precision or lies entirely below the win threshold, where the setup scores zero
+ however precise it gets.  The iteration count then only caps how many trials a prediction may
+ use.
+
+ Simulated trials are tallied in 64 bit counters and Welford running means, merged across chunks
+ and threads, so even billions of trials per prediction neither overflow nor lose precision, and
+ every sampled estimate is printed with its standard error.
+
+ Random numbers come from xoshiro256**, seeded from the clock unless --seed is given.
+
+ Sampled simulations advance BATCH_LANE_COUNT independent trials at once, one per vector lane,
+ refilling lanes as their trials finish.  Passing --scalar runs one trial at a time instead.
+
+ Bonus units are allocated by dynamic programming over (attack vector, bonus units spent), keeping
+ the --top highest scoring partial plans for every cell.  Passing --exhaustive instead enumerates
+ every possible allocation, which is only practical for a handful of vectors.  Either way only the
+ --top plans are ever held in memory, each as a packed array of per-vector bonus units.
+
+ Win likelihood never drops as bonus units are added, so --monotone gallops and then bisects for
+ the fewest bonus units at which each vector clears the win threshold, and again for the fewest at
+ which it is certain to win, or within --precision of certain.  Below the first level a setup
+ scores zero and past the second it scores what the second level does, so only the levels in
+ between are predicted up front.  Setups of the reported plans that were skipped are predicted
+ afterwards, just for printing.
+
+ With --memo, the exact outcome distribution of every (front units, defending units) battle is
+ computed once, kept in a memo of the given size and sampled in constant time from then on.  Hit
+ and miss counts are printed at the end of the run to help size it.
+
+ With --serve, one process answers many queries.  Each line read from stdin, or from connections
+ to the --socket given, holds the [simulation iterations] [bonus units] [win threshold] [attack
+ vectors] arguments and is answered with one line: "ok trials=N" followed by "plan=I score=S"
+ for every planned setup and "vector=V bonus=B win=W units=U territories=T enemies=E" with the
+ matching "win_se", "units_se", "territories_se" and "enemies_se" standard errors for every
+ prediction, or "error" and a reason.  Queries may be sent ahead of their answers, which are
+ flushed whenever the input runs dry, and the roll tables, threads and memo stay warm between
+ them.  A "quit" line stops the server.
+
+ With --session, stdin holds a what-if session.  Its first line is a query in the --serve format
+ and every later line either replaces the query or edits one of its attack vectors: "set I V"
+ replaces vector I, counting from 1, with V, "add V" appends V and "remove I" drops vector I.
+ Predictions of every bonus level of every vector stay resident, so an edit only predicts the
+ one vector it touched before planning again over all of them.  Every line is answered like a
+ --serve query, its trials counting only the predictions that line needed, until "quit".
+
+ With --batch, a file of query lines in the --serve format is mapped into memory and answered in
+ order, one result line per query, to stdout or the --output file.  Lines are split and parsed
+ in place, in segments cut into line aligned ranges by file offset that the worker threads parse
+ in parallel, each into its own arena, so even an archive of millions of past positions costs no
+ allocation per query.  The queries themselves then run one after another across the whole pool.
+
+ With --table, a battle table written by warplan-gentable is mapped at startup.  It holds the
+ outcome distribution of every battle up to its front and defender bounds, so a vector whose
+ front and territories all fit is predicted exactly instead of simulated: a lone territory is a
+ single lookup and chains convolve table entries wherever that beats solving the battle outright.
+ Vectors outside the table, and branching ones, are simulated as usual.  --exact predictions also
+ read battles from the table.
+
+ Three options trade nothing in accuracy for less noise between simulated predictions.  With
+ --common-random every prediction draws from the same random streams rather than one of its own,
+ so bonus levels and vectors are compared under the same luck and plans stop flipping between
+ runs.  With --antithetic, chunks come in pairs sharing a stream, the second with every random
+ bit flipped so each die reads about 7-d.  With --control, each simulated trial also sums the
+ attacking units its rolls lost beyond their exact expectation, a quantity of known zero mean,
+ and the win likelihood is corrected by its fitted regression on that sum.
+
+ A fixed size simulated run can be split across processes or machines with --shard i/n, where
+ shard i runs every n-th chunk of trials of every prediction, chunk streams being disjoint, and
+ writes the raw tallies of every prediction to --output along with its query, seed and options.
+ The shards must share a --seed.  warplan --merge then reads all n shard files, given in place of
+ the query, merges their tallies and prints the predictions and plans the whole run would have.
+
+ With --fast-forward, large battles skip ahead through their full strength rounds, where both
+ sides roll every die the --rules allow and every round removes exactly as many units as dice are
+ compared, 2 for the default 3 dice against 2 and 3 when the defender also rolls 3.  The attacking
+ losses over 2^j such rounds are precomputed by repeated convolution and sampled in one step
+ whenever neither side can drop below full strength within the jump, so a battle takes a number
+ of steps logarithmic in its size before it is rolled out one round at a time and stays exact
+ throughout.
+
+ Passing --stats prints counters gathered during the run, trials, single attacks, dice rolled,
+ plan candidates scored and kept and bytes allocated, along with the monotonic time spent in
+ each phase: setup, prediction, planning, sorting and reporting.  Every engine counts the dice
+ of each roll it resolves, whether drawn die by die or as a whole roll outcome, though battles
+ sampled whole from the --memo roll none.  Counters are kept per worker and only summed for the
+ report, so they cost next to nothing when not printed.
+
+ Tracing is compiled into warplan-d and warplan-t only, both built with WARPLAN_TRACE, the first
+ unoptimized for debuggers and the second at full optimization for tracing production sized runs.
+ There --trace maps a trace file holding one ring of fixed size binary records per worker thread,
+ adding --dice records every rolled die.  Setting DEBUG_WARPLAN, the old debugging switch, traces every rolled die too,
+ to warplan.trace unless --trace names a file, and only draws a warning from other builds.
+ Chunks, trials, territories, dice, losses and conquests are recorded without any formatting,
+ the rings keep the most recent records of even very long runs, and warplan-trace decodes the
+ file afterwards.
+
 
  Example command lines can be seen below:
 
@@ -28,22 +160,43 @@
  Simulate multiple attack vectors, no planning:
      ./warplan 1000 0 0 7:1,1,2 4:5,1\n"
 
+ Simulate an attack that forks after its first territory:
+     ./warplan 1000 0 0 10:3[2,99][4]
+
  Given 10 bonus armies, plan an attack across multiple vectors requiring a win likelihood of 0.8:
      ./warplan 1000 10 0.8 3:2,2 4:1,1,1,1 2:2,1,2
+
+ Plan the same attack using exact predictions:
+     ./warplan --exact 0 10 0.8 3:2,2 4:1,1,1,1 2:2,1,2
+
+ Plan it from one exact sweep per vector, printing each vector's win likelihood curve:
+     ./warplan --curve 0 10 0.8 3:2,2 4:1,1,1,1 2:2,1,2
+
+ Plan it with 3 defending dice, 8 sided dice and 2 units left behind on every territory:
+     ./warplan --rules 3v3d8l2 1000 10 0.8 3:2,2 4:1,1,1,1 2:2,1,2
  */
 
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <stdarg.h>
+#include <stdint.h>
 #include <sys/param.h>
-#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 
 enum program_args
 {
-    program_arg_binary_name,
     program_arg_sim_iterations,
     program_arg_bonus_units,
     program_arg_likelihood_threshold,
@@ -52,7 +205,48 @@ enum program_args
 
 enum program_flags
 {
-    enable_debugging = 0x01
+    enable_tracing       = 0x01,
+    enable_exact_engine  = 0x02,
+    enable_dice_rolls    = 0x04,
+    enable_scalar_trials = 0x08,
+    enable_exhaustive    = 0x10,
+    enable_monotone      = 0x20,
+    enable_battle_memo   = 0x40,
+    enable_serve         = 0x80,
+    enable_stats         = 0x100,
+    enable_fast_forward  = 0x200,
+    enable_batch         = 0x400,
+    enable_battle_table  = 0x800,
+    enable_common_random = 0x1000,
+    enable_antithetic    = 0x2000,
+    enable_control       = 0x4000,
+    enable_shard         = 0x8000,
+    enable_merge         = 0x10000,
+    enable_session       = 0x20000,
+    enable_curve         = 0x40000
+};
+
+enum trace_event
+{
+    trace_chunk,
+    trace_trial,
+    trace_territory,
+    trace_dice,
+    trace_losses,
+    trace_battle,
+    trace_conquered,
+    trace_failed,
+    trace_fast_forward
+};
+
+enum run_phase
+{
+    phase_setup,
+    phase_predict,
+    phase_plan,
+    phase_sort,
+    phase_report,
+    phase_count
 };
 
 enum combinations_state
@@ -61,21 +255,84 @@ enum combinations_state
     combinations_remain
 };
 
-#define DEBUG_ENV_NAME "DEBUG_WARPLAN"
+#define DEBUG_ENV_NAME     "DEBUG_WARPLAN"
+#define DEBUG_TRACE_PATH   "warplan.trace"
+
+#define TRACE_MAGIC        "WPTRACE2"
+#define TRACE_RING_RECORDS (1 << 20)
 
-#define MAX_TERRITORY_VECTOR_SIZE 128
-#define MAX_ATTACK_VECTORS        16
-#define MAX_DICE_STRING_SIZE      512
+#define ARENA_BLOCK_SIZE (64*1024)
+#define ARENA_ALIGNMENT  16
+#define ARENA_HEADER_SIZE ((sizeof(struct arena_block)+ARENA_ALIGNMENT-1)&~(size_t)(ARENA_ALIGNMENT-1))
 
-#define MIN_TERRITORY_UNITS   1
+/* Bounds on every ruleset below, the rules of the run itself are held in run_rules */
 #define MAX_DICE_COUNT        3
 #define MAX_ATTACK_DICE_COUNT 3
-#define MAX_DEFEND_DICE_COUNT 2
+#define MAX_DEFEND_DICE_COUNT 3
+
+#define MAX_COMPARE_DICE_COUNT MIN(MAX_ATTACK_DICE_COUNT, MAX_DEFEND_DICE_COUNT)
+#define MAX_ROLL_OUTCOMES      (MAX_COMPARE_DICE_COUNT+1)
+#define EXACT_ROW_COUNT        (MAX_DEFEND_DICE_COUNT+1)
+#define ROLL_COMBINATION_COUNT ((MAX_ATTACK_DICE_COUNT+1)*(MAX_DEFEND_DICE_COUNT+1))
+
+#define DICE_BITS 4
+
+/*
+ Every ruleset is named [attack dice]v[defend dice]d[dice sides], with l[units] appended when
+ more than one unit must stay behind on a territory, and gets trial kernels of its own with its
+ rules compiled in.  Fields are the name, attack dice, defend dice, dice sides and units left.
+ */
+#define DICE_RULESETS(RULESET)          \
+    RULESET(3v2d6,   3, 2, 6, 1)        \
+    RULESET(3v3d6,   3, 3, 6, 1)        \
+    RULESET(3v2d8,   3, 2, 8, 1)        \
+    RULESET(3v3d8,   3, 3, 8, 1)        \
+    RULESET(3v2d6l2, 3, 2, 6, 2)        \
+    RULESET(3v3d6l2, 3, 3, 6, 2)        \
+    RULESET(3v2d8l2, 3, 2, 8, 2)        \
+    RULESET(3v3d8l2, 3, 3, 8, 2)
+
+#define DEFAULT_DICE_RULES "3v2d6"
+
+/* The batch kernel draws rolls with a 16 bit multiply, larger roll tables take the scalar path */
+#define MAX_BATCH_ROLL_COUNT (1u << 16)
+
+#define MAX_PLAN_BONUS_UNITS UINT16_MAX
+#define MAX_SIM_ITERATIONS   (UINT64_C(1) << 48)
+
+#define PREDICTION_CHUNK_ITERATIONS 1024
+#define PREDICTION_PASS_TASKS       4096
+#define NO_LIKELIHOOD_THRESHOLD     -1.0f
+#define DEFAULT_CONFIDENCE          0.95
+
+#define RANDOM_STATE_SIZE 4
+
+#define BATCH_LANE_COUNT 8
+
+#define SERVE_LINE_SIZE    4096
+#define SERVE_SOCKET_QUEUE 16
 
-#define DICE_SIDES          6
-#define MAX_DICE_RAND_VALUE ((UINT_MAX/DICE_SIDES)*DICE_SIDES)
+#define BATCH_SEGMENT_SIZE      (1024*1024)
+#define BATCH_RANGES_PER_WORKER 4
 
-#define PLANS_SIZE_INCREMENT 100000
+#define FAST_FORWARD_LEVEL_COUNT 12
+
+#define BATTLE_TABLE_MAGIC     "WPTABLE"
+#define BATTLE_TABLE_VERSION   2
+#define BATTLE_TABLE_ALIGNMENT 4096
+
+#define SHARD_MAGIC   "WPSHARD"
+#define SHARD_VERSION 2
+
+/* Options a shard's tallies depend on, all shards of a run must agree on them */
+#define SHARD_RESULT_FLAGS (                                                                   \
+                            enable_dice_rolls|enable_scalar_trials|enable_battle_memo|          \
+                            enable_fast_forward|enable_common_random|enable_antithetic|         \
+                            enable_control|enable_exhaustive|enable_battle_table                \
+                           )
+
+#define BATTLE_MEMO_MIN_SLOTS      1024
+#define BATTLE_MEMO_BYTES_PER_SLOT 1024
 
 
 struct territory_def
@@ -83,14 +340,90 @@ struct territory_def
     unsigned int units;
 };
 
+/*
+ Territories and the suffix sums of their enemy units live in the scenario arena, so a vector
+ is one small header pointing at two tightly packed arrays.  enemy_units_after[index] counts the
+ enemies in every territory past index, branches included, which is all a lost trial needs to
+ tally what is left.
+
+ A vector may end in branches, each itself a vector attacking from the last territory conquered
+ with a share of the survivors.  Only the root carries a def_string and units_on_front.
+ */
 struct attack_vector_def
 {
     char* def_string;
 
     unsigned int units_on_front;
 
-    struct territory_def territory_vector[MAX_TERRITORY_VECTOR_SIZE];
-    unsigned int         territory_count;
+    struct territory_def* territory_vector;
+    unsigned int*         enemy_units_after;
+    unsigned int          territory_count;
+
+    struct attack_vector_def* branches;
+    unsigned int              branch_count;
+    unsigned int              subtree_enemy_units;
+    unsigned int              subtree_territory_count;
+};
+
+struct war_query
+{
+    uint64_t                  sim_iterations;
+    unsigned int              bonus_units;
+    float                     likelihood_threshold;
+    struct attack_vector_def* attack_vectors;
+    size_t                    attack_vector_count;
+};
+
+struct arena_block
+{
+    struct arena_block* next;
+    size_t              size;
+    size_t              used;
+};
+
+struct arena
+{
+    struct arena_block* blocks;
+    size_t              total_size;
+    size_t              reserve_size;
+};
+
+/* Queries parsed from one line aligned slice of a batch file, held in the slice's own arena */
+struct batch_query
+{
+    struct war_query query;
+    char*            error;
+};
+
+struct batch_range
+{
+    char*               begin;
+    char*               end;
+    struct arena        arena;
+    struct batch_query* queries;
+    size_t              query_count;
+    int                 quit;
+};
+
+/* A what-if session keeps its setup rows, one per attack vector, between commands */
+struct war_session
+{
+    struct war_query      query;
+    struct arena          arena;
+    struct arena          spare_arena;
+    struct attack_setup*  setups;
+    struct attack_setup** pending_setups;
+    size_t                vector_capacity;
+    int                   active;
+};
+
+struct line_reader
+{
+    int    fd;
+    char*  buffer;
+    size_t capacity;
+    size_t start;
+    size_t end;
 };
 
 struct attack_result
@@ -100,6 +433,23 @@ struct attack_result
     unsigned int enemy_units_on_front;
 };
 
+struct tree_result
+{
+    unsigned int units_on_front;
+    unsigned int enemy_units_remaining;
+    unsigned int territories_remaining;
+};
+
+/* A subtree's win likelihood from one front size, and each total weighted by the likelihood of its outcome */
+struct exact_value
+{
+    double win_likelihood;
+    double units_on_front;
+    double enemy_units_remaining;
+    double territories_remaining;
+};
+
+/* Sampled predictions carry the standard error of every estimate, exact ones leave them zero */
 struct attack_prediction
 {
     float win_likelihood;
@@ -107,8 +457,305 @@ struct attack_prediction
     float estimated_remaining_enemies_if_loss;
     float estimated_remaining_territories_if_loss;
 
-    unsigned int win_count;
-    unsigned int loss_count;
+    float win_likelihood_error;
+    float remaining_units_if_win_error;
+    float remaining_enemies_if_loss_error;
+    float remaining_territories_if_loss_error;
+
+    uint64_t win_count;
+    uint64_t loss_count;
+};
+
+/* Welford's streaming mean and sum of squared deviations, merged across chunks by Chan's update */
+struct running_stats
+{
+    uint64_t count;
+    double   mean;
+    double   squared_deviations;
+};
+
+struct dice_rules
+{
+    unsigned int attack_dice_count;
+    unsigned int defend_dice_count;
+    unsigned int dice_sides;
+    unsigned int min_territory_units;
+};
+
+struct roll_outcome
+{
+    unsigned int lost_attack_units;
+    unsigned int lost_defend_units;
+    unsigned int roll_count;
+    unsigned int cumulative_roll_count;
+    double       likelihood;
+};
+
+struct roll_outcomes
+{
+    struct roll_outcome outcomes[MAX_ROLL_OUTCOMES];
+    unsigned int        outcome_count;
+    unsigned int        roll_count;
+    double              expected_lost_attack_units;
+};
+
+struct prediction_tally
+{
+    uint64_t             win_count;
+    uint64_t             loss_count;
+    struct running_stats units_on_front;
+    struct running_stats enemy_units_remaining;
+    struct running_stats territories_remaining;
+
+    double control_sum;
+    double control_square_sum;
+    double win_control_sum;
+};
+
+struct prediction_cell
+{
+    struct attack_vector_def* attack_vector;
+    unsigned int              bonus_units;
+    struct attack_prediction* prediction;
+    int                       from_table;
+};
+
+struct prediction_task
+{
+    size_t cell_index;
+    size_t chunk_index;
+};
+
+struct prediction_job
+{
+    struct prediction_cell*  cells;
+    uint64_t                 sim_iterations;
+    struct prediction_task*  tasks;
+    struct prediction_tally* tallies;
+};
+
+struct sim_context
+{
+    uint64_t random_state[RANDOM_STATE_SIZE];
+    uint64_t antithetic_mask;
+    uint32_t spare_random_bits;
+    int      has_spare_random_bits;
+
+    /* Attacking units lost in the current trial beyond what its rolls were expected to cost */
+    double control_units;
+
+    uint64_t memo_hits;
+    uint64_t memo_misses;
+    uint64_t dice_rolled;
+    uint64_t single_attacks;
+
+#ifdef WARPLAN_TRACE
+    struct trace_ring* trace;
+#endif
+};
+
+/*
+ Trace records are fixed size so a ring of them can live in an mmap'd file and be decoded
+ offline by warplan-trace.  Dice are packed DICE_BITS apiece into detail, attack dice first,
+ with a zero marking a missing die.
+ */
+struct trace_record
+{
+    uint32_t event;
+    uint32_t detail;
+    uint32_t values[2];
+};
+
+struct trace_ring
+{
+    uint64_t            record_count;
+    uint64_t            capacity;
+    struct trace_record records[];
+};
+
+struct trace_file_header
+{
+    char     magic[8];
+    uint32_t worker_count;
+    uint32_t ring_capacity;
+};
+
+struct run_stats
+{
+    uint64_t       trials;
+    uint64_t       exact_predictions;
+    uint64_t       curve_sweeps;
+    uint64_t       plan_candidates;
+    uint64_t       plans_kept;
+    uint64_t       bytes_allocated;
+    double         phase_seconds[phase_count];
+    double         phase_started;
+    enum run_phase phase;
+    int            timing;
+};
+
+struct battle_outcomes
+{
+    uint64_t     key;
+    size_t       size;
+    double       win_likelihood;
+    unsigned int win_outcome_count;
+    unsigned int outcome_count;
+    double*      acceptances;
+    uint32_t*    aliases;
+};
+
+struct fast_forward_level
+{
+    unsigned int round_count;
+    unsigned int outcome_count;
+    double*      acceptances;
+    uint32_t*    aliases;
+};
+
+/*
+ Table files start with this header on a page of its own, then one entry per (front units,
+ defending units) pair, fronts outermost, and then every entry's outcome likelihoods, each
+ section page aligned.  Likelihoods are ordered like the battle memo's outcomes.
+ */
+struct battle_table_header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t max_front_units;
+    uint32_t max_territory_units;
+    uint32_t entry_count;
+
+    struct dice_rules rules;
+
+    uint64_t entry_offset;
+    uint64_t likelihood_offset;
+    uint64_t file_size;
+};
+
+struct battle_table_entry
+{
+    uint64_t likelihood_offset;
+    double   win_likelihood;
+    double   units_if_win;
+    double   defenders_if_loss;
+};
+
+/*
+ Shard files hold this header, the query text the shard ran, and then the raw tally of every
+ prediction cell in the order the run predicted them
+ */
+struct shard_file_header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t shard_index;
+    uint32_t shard_count;
+    uint32_t top_plans;
+    uint64_t seed;
+    uint64_t flags;
+    uint64_t query_size;
+    uint64_t cell_count;
+
+    struct dice_rules rules;
+};
+
+struct shard_file
+{
+    struct shard_file_header header;
+    FILE*                    stream;
+};
+
+struct battle_table
+{
+    char*                       mapping;
+    size_t                      mapping_size;
+    struct battle_table_header* header;
+    struct battle_table_entry*  entries;
+};
+
+struct battle_memo
+{
+    struct battle_outcomes** slots;
+    size_t                   slot_count;
+    size_t                   entry_count;
+    size_t                   byte_count;
+    size_t                   byte_budget;
+    pthread_mutex_t          lock;
+};
+
+typedef uint32_t lane_units __attribute__((vector_size(BATCH_LANE_COUNT*sizeof(uint32_t))));
+typedef int32_t  lane_mask  __attribute__((vector_size(BATCH_LANE_COUNT*sizeof(int32_t))));
+
+struct batch_context
+{
+    lane_units random_state[RANDOM_STATE_SIZE];
+    lane_units antithetic_mask;
+    lane_units attack_counts;
+    lane_units dice_counts;
+};
+
+typedef void (*task_function)(void* context, size_t task_index, struct sim_context* sim);
+
+typedef void (*tree_kernel)(
+                            struct sim_context*       sim,
+                            struct attack_vector_def* attack_vector,
+                            unsigned int              units_on_front,
+                            struct tree_result*       result
+                           );
+typedef void (*trial_kernel)(
+                             struct sim_context*       sim,
+                             struct attack_vector_def* attack_vector,
+                             unsigned int              bonus_units,
+                             unsigned int              sim_iterations,
+                             struct prediction_tally*  tally
+                            );
+typedef void (*batch_kernel)(
+                             struct batch_context*     batch,
+                             struct attack_vector_def* attack_vector,
+                             unsigned int              bonus_units,
+                             unsigned int              sim_iterations,
+                             struct prediction_tally*  tally
+                            );
+
+struct ruleset
+{
+    char*             name;
+    struct dice_rules rules;
+    trial_kernel      simulate_trials;
+    batch_kernel      simulate_batch;
+};
+
+struct task_range
+{
+    pthread_mutex_t lock;
+    size_t          next_task;
+    size_t          end_task;
+};
+
+struct worker
+{
+    struct thread_pool* pool;
+    struct task_range   range;
+    struct sim_context  sim;
+    pthread_t           thread;
+    unsigned int        index;
+};
+
+struct thread_pool
+{
+    struct worker*  workers;
+    unsigned int    worker_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  work_ready;
+    pthread_cond_t  work_done;
+    unsigned int    generation;
+    unsigned int    active_count;
+    int             shutting_down;
+
+    task_function   function;
+    void*           context;
 };
 
 struct attack_setup
@@ -117,18 +764,85 @@ struct attack_setup
     struct attack_vector_def* attack_vector;
     unsigned int              bonus;
     float                     score;
+    int                       evaluated;
+};
+
+struct curve_job
+{
+    struct attack_setup* setups;
+    unsigned int         bonus_units;
+};
+
+struct bonus_search
+{
+    unsigned int known_false;
+    unsigned int known_true;
+    unsigned int gallop_step;
+    unsigned int probe;
+    int          searching;
 };
 
 struct attack_plan
 {
-    float total_score;
+    float     total_score;
+    uint16_t* bonuses;
+};
+
+struct plan_heap
+{
+    struct attack_plan* plans;
+    uint16_t*           bonus_pool;
+    size_t              plan_count;
+    size_t              capacity;
+    size_t              attack_vector_count;
+};
 
-    struct attack_setup* setups[MAX_ATTACK_VECTORS];
-    size_t               setup_count;
+struct allocation_entry
+{
+    float        total_score;
+    unsigned int bonus;
+    unsigned int parent_rank;
 };
 
 
 static enum program_flags run_flags;
+static struct ruleset*    run_ruleset;
+static struct dice_rules  run_rules;
+static uint64_t           run_seed;
+static int                run_seed_given;
+static unsigned int       run_thread_count;
+static unsigned int       run_top_plans;
+static double             run_precision;
+static double             run_confidence;
+static double             run_confidence_z;
+static size_t             run_memo_megabytes;
+static char*              run_serve_socket;
+static char*              run_trace_path;
+static char*              run_batch_path;
+static char*              run_batch_output;
+static char*              run_table_path;
+static struct thread_pool run_pool;
+static struct battle_memo run_memo;
+static struct battle_table run_table;
+static unsigned int       run_shard_index;
+static unsigned int       run_shard_count;
+static struct shard_file* run_shards;
+static struct run_stats   run_stats;
+static struct arena       run_arena;
+
+static char* run_phase_names[phase_count] = {"setup", "predict", "plan", "sort", "report"};
+
+static struct roll_outcomes roll_outcome_table[MAX_ATTACK_DICE_COUNT+1][MAX_DEFEND_DICE_COUNT+1];
+
+/*
+ Cumulative roll counts of every dice combination rescaled to the roll count of the largest
+ combination, indexed by [outcome][combination], so a vector of lanes can share one draw range
+ */
+static uint32_t roll_outcome_thresholds[MAX_COMPARE_DICE_COUNT][ROLL_COMBINATION_COUNT];
+static uint32_t roll_table_count;
+
+/* Attacking units lost over 2^level full strength rounds, sampled through alias tables */
+static struct fast_forward_level fast_forward_levels[FAST_FORWARD_LEVEL_COUNT];
 
 
 static inline void
@@ -138,608 +852,5452 @@ Abort (char* reason)
     exit(EXIT_FAILURE);
 }
 
+#ifdef WARPLAN_TRACE
+
 static inline void
-Debug (char* format_string, ...)
+Trace (struct sim_context* sim, enum trace_event event, uint32_t detail, uint32_t first, uint32_t second)
 {
-    va_list arg_list;
+    struct trace_ring*   ring;
+    struct trace_record* record;
 
-    if(!(run_flags&enable_debugging))
+    ring = sim->trace;
+    if(ring == NULL)
         return;
 
-    va_start(arg_list, format_string);
-    vprintf(format_string, arg_list);
-    va_end(arg_list);
-}
+    /* Only the worker owning the ring ever writes it, old records are simply overwritten */
+    record = &ring->records[ring->record_count&(ring->capacity-1)];
 
-static inline void
-ParseAttackVector (char* def_string, struct attack_vector_def* attack_vector)
-{
-    char*                 param;
-    char*                 dup_def_string;
-    struct territory_def* territory_vector;
-    unsigned int          territory_count;
+    record->event     = event;
+    record->detail    = detail;
+    record->values[0] = first;
+    record->values[1] = second;
 
-    dup_def_string = strdup(def_string);
-    if(dup_def_string == NULL)
-        Abort("Failed to alloc memory");
+    ring->record_count++;
+}
 
-    param = strtok(dup_def_string, ":");
-    if(param == NULL)
-        goto invalid_def_string;
+#define TRACE(sim, event, detail, first, second) Trace(sim, event, detail, first, second)
 
-    attack_vector->units_on_front = (unsigned int)atoi(param);
+#else
 
-    territory_vector = attack_vector->territory_vector;
-    territory_count  = 0;
+#define TRACE(sim, event, detail, first, second) ((void)0)
 
-    while((param = strtok(NULL, ",")) != NULL)
-    {
-        territory_vector[territory_count].units = (unsigned int)atoi(param);
-        territory_count++;
-    }
+#endif
 
-    if(territory_count == 0)
-        goto invalid_def_string;
+static inline uint32_t
+PackDice (unsigned int* attack_dice, unsigned int attack_dice_count, unsigned int* defend_dice, unsigned int defend_dice_count)
+{
+    uint32_t packed;
 
-    attack_vector->def_string      = def_string;
-    attack_vector->territory_count = territory_count;
+    packed = 0;
 
-    free(dup_def_string);
+    for(unsigned int index = 0; index < attack_dice_count; index++)
+        packed |= attack_dice[index] << (index*DICE_BITS);
 
-    return;
+    for(unsigned int index = 0; index < defend_dice_count; index++)
+        packed |= defend_dice[index] << ((MAX_ATTACK_DICE_COUNT+index)*DICE_BITS);
 
-invalid_def_string:
-    Abort("Malformed attack vector string, see usage");
+    return packed;
 }
 
-static inline void
-PrintPrediction (char* vector_def_string, struct attack_prediction* prediction)
+static inline double
+MonotonicSeconds (void)
 {
-    printf(
-           "Attack vector '%s' prediction\n"
-           "\tWin count: %u Loss count: %u\n",
-           vector_def_string,
-           prediction->win_count,
-           prediction->loss_count
-          );
+    struct timespec now;
 
-    if(prediction->win_count > 0)
-    {
-        printf(
-               "\tWin likelihood: %.2f with %.2f units remaning\n",
-               prediction->win_likelihood,
-               prediction->estimated_remaining_units_if_win
-              );
-    }
-    else
-        printf("\tWin likelihood: 0 this is a debo move\n");
+    clock_gettime(CLOCK_MONOTONIC, &now);
 
-    if(prediction->loss_count > 0)
-    {
-        printf(
-               "\t\tIf loss, %.2f remaining territories with %.2f enemies total\n",
-               prediction->estimated_remaining_enemies_if_loss,
-               prediction->estimated_remaining_territories_if_loss
-              );
-    }
+    return (double)now.tv_sec+(double)now.tv_nsec*1e-9;
 }
 
 static inline void
-PrintSetup (struct attack_setup* setup)
+EnterPhase (enum run_phase phase)
 {
-    char* def_string;
+    double now;
 
-    def_string = setup->attack_vector->def_string;
+    now = MonotonicSeconds();
 
-    printf(
-           "%u bonus armies to attack vector '%s'\n",
-           setup->bonus,
-           def_string
-          );
-    PrintPrediction(def_string, &setup->prediction);
+    if(run_stats.timing)
+        run_stats.phase_seconds[run_stats.phase] += now-run_stats.phase_started;
+
+    run_stats.phase         = phase;
+    run_stats.phase_started = now;
+    run_stats.timing        = 1;
 }
 
 static inline void
-DiceToString (unsigned int* dice, unsigned int count, char* string)
+LeavePhase (void)
 {
-    char*        cursor;
-    unsigned int comma_sep_count;
+    if(run_stats.timing)
+        run_stats.phase_seconds[run_stats.phase] += MonotonicSeconds()-run_stats.phase_started;
 
-    cursor          = string;
-    comma_sep_count = count-1;
+    run_stats.timing = 0;
+}
 
-    for(unsigned int index = 0; index < comma_sep_count; index++)
-        cursor += sprintf(cursor, "%u, ", dice[index]);
+static inline void
+CountAllocation (size_t size)
+{
+    __atomic_fetch_add(&run_stats.bytes_allocated, size, __ATOMIC_RELAXED);
+}
 
-    sprintf(cursor, "%u", dice[comma_sep_count]);
+static inline void
+InitArena (struct arena* arena)
+{
+    arena->blocks       = NULL;
+    arena->total_size   = 0;
+    arena->reserve_size = ARENA_BLOCK_SIZE;
 }
 
-static int
-CompareDice (const void* left, const void* right)
+static inline void
+FreeArena (struct arena* arena)
 {
-    unsigned int left_value;
-    unsigned int right_value;
-    int          delta;
+    while(arena->blocks != NULL)
+    {
+        struct arena_block* block;
 
-    left_value  = *(unsigned int*)left;
-    right_value = *(unsigned int*)right;
+        block         = arena->blocks;
+        arena->blocks = block->next;
 
-    delta = (int)right_value-(int)left_value;
+        free(block);
+    }
 
-    return delta;
+    arena->total_size = 0;
 }
 
-static int
-ComparePlan (const void* left, const void* right)
+static inline void*
+ArenaAlloc (struct arena* arena, size_t size)
 {
-    const struct attack_plan* left_plan;
-    const struct attack_plan* right_plan;
+    struct arena_block* block;
+    void*               memory;
 
-    left_plan  = left;
-    right_plan = right;
+    size  = (size+ARENA_ALIGNMENT-1)&~(size_t)(ARENA_ALIGNMENT-1);
+    block = arena->blocks;
 
-    if(right_plan->total_score > left_plan->total_score)
-        return 1;
-    else if(right_plan->total_score < left_plan->total_score)
-        return -1;
+    if(block == NULL || block->used+size > block->size)
+    {
+        size_t block_size;
 
-    return 0;
-}
+        block_size = MAX(arena->reserve_size, size);
 
-static inline unsigned int
-UniformDiceRoll (void)
-{
-    unsigned int rand_value;
-    unsigned int dice_value;
+        block = malloc(ARENA_HEADER_SIZE+block_size);
+        if(block == NULL)
+            Abort("Failed to alloc memory for arena");
 
-    do
-    {
-        rand_value = rand();
-    }while(rand_value >= MAX_DICE_RAND_VALUE);
+        CountAllocation(ARENA_HEADER_SIZE+block_size);
 
-    dice_value = (rand_value%DICE_SIDES)+1;
+        block->next = arena->blocks;
+        block->size = block_size;
+        block->used = 0;
 
-    return dice_value;
+        arena->blocks      = block;
+        arena->total_size += block_size;
+    }
+
+    memory       = (char*)block+ARENA_HEADER_SIZE+block->used;
+    block->used += size;
+
+    return memory;
 }
 
-static inline void
-RollDice (unsigned int* dice, unsigned int count)
+static inline char*
+ArenaCopyString (struct arena* arena, char* string)
 {
-    for(size_t index = count; index-- > 0;)
-        dice[index] = UniformDiceRoll();
+    char* copy;
 
-    qsort(dice, count, sizeof(unsigned int), &CompareDice);
+    copy = ArenaAlloc(arena, strlen(string)+1);
+    strcpy(copy, string);
+
+    return copy;
 }
 
 static inline void
-SingleAttack (
-              unsigned int  units_on_front,
-              unsigned int  territory_units,
-              unsigned int* remaining_units_on_front,
-              unsigned int* remaining_territory_units
+ResetArena (struct arena* arena)
+{
+    /* A scenario that spilled into several blocks gets a single block big enough next time */
+    if(arena->blocks != NULL && arena->blocks->next != NULL)
+    {
+        arena->reserve_size = arena->total_size;
+
+        FreeArena(arena);
+    }
+    else if(arena->blocks != NULL)
+        arena->blocks->used = 0;
+}
+
+static inline char*
+ParseAttackBranch (struct arena* arena, char** cursor, struct attack_vector_def* attack_vector)
+{
+    struct territory_def* territory_vector;
+    unsigned int*         enemy_units_after;
+    unsigned int          territory_count;
+    unsigned int          branch_count;
+    unsigned int          branch_enemy_units;
+    unsigned int          branch_territory_count;
+    char*                 scan;
+    char*                 end;
+
+    /* Both arrays are sized from the separators before anything is parsed into them */
+    territory_count = 0;
+    if(**cursor != '[' && **cursor != ']' && **cursor != '\0')
+    {
+        territory_count = 1;
+        for(scan = *cursor; *scan != '\0' && *scan != '[' && *scan != ']'; scan++)
+            territory_count += *scan == ',';
+    }
+
+    territory_vector  = ArenaAlloc(arena, territory_count*sizeof(struct territory_def));
+    enemy_units_after = ArenaAlloc(arena, territory_count*sizeof(unsigned int));
+
+    for(unsigned int index = 0; index < territory_count; index++)
+    {
+        territory_vector[index].units = (unsigned int)strtoul(*cursor, &end, 10);
+        if(end == *cursor)
+            return "Malformed attack vector string, see usage";
+
+        *cursor = end;
+
+        if(index+1 < territory_count)
+        {
+            if(**cursor != ',')
+                return "Malformed attack vector string, see usage";
+
+            (*cursor)++;
+        }
+    }
+
+    branch_count = 0;
+    for(scan = *cursor; *scan == '[';)
+    {
+        unsigned int depth;
+
+        for(depth = 0; *scan != '\0'; scan++)
+        {
+            depth += *scan == '[';
+            depth -= *scan == ']';
+            if(depth == 0)
+                break;
+        }
+
+        if(*scan != ']')
+            return "Unbalanced branch brackets in attack vector";
+
+        scan++;
+        branch_count++;
+    }
+
+    if(territory_count == 0 && branch_count == 0)
+        return "Malformed attack vector string, see usage";
+
+    attack_vector->branches     = ArenaAlloc(arena, branch_count*sizeof(struct attack_vector_def));
+    attack_vector->branch_count = branch_count;
+
+    branch_enemy_units     = 0;
+    branch_territory_count = 0;
+
+    for(unsigned int index = 0; index < branch_count; index++)
+    {
+        struct attack_vector_def* branch;
+        char*                     error;
+
+        branch = &attack_vector->branches[index];
+
+        (*cursor)++;
+
+        error = ParseAttackBranch(arena, cursor, branch);
+        if(error != NULL)
+            return error;
+
+        if(**cursor != ']')
+            return "Malformed attack vector string, see usage";
+
+        (*cursor)++;
+
+        branch_enemy_units     += branch->subtree_enemy_units;
+        branch_territory_count += branch->subtree_territory_count;
+    }
+
+    if(territory_count > 0)
+    {
+        enemy_units_after[territory_count-1] = branch_enemy_units;
+        for(size_t index = territory_count-1; index-- > 0;)
+            enemy_units_after[index] = enemy_units_after[index+1]+territory_vector[index+1].units;
+
+        attack_vector->subtree_enemy_units = territory_vector[0].units+enemy_units_after[0];
+    }
+    else
+        attack_vector->subtree_enemy_units = branch_enemy_units;
+
+    attack_vector->def_string              = NULL;
+    attack_vector->units_on_front          = 0;
+    attack_vector->territory_vector        = territory_vector;
+    attack_vector->enemy_units_after       = enemy_units_after;
+    attack_vector->territory_count         = territory_count;
+    attack_vector->subtree_territory_count = territory_count+branch_territory_count;
+
+    return NULL;
+}
+
+static inline char*
+ParseAttackVector (struct arena* arena, char* def_string, struct attack_vector_def* attack_vector)
+{
+    unsigned int units_on_front;
+    char*        cursor;
+    char*        error;
+
+    units_on_front = (unsigned int)strtoul(def_string, &cursor, 10);
+    if(cursor == def_string || *cursor != ':')
+        return "Malformed attack vector string, see usage";
+
+    cursor++;
+
+    error = ParseAttackBranch(arena, &cursor, attack_vector);
+    if(error != NULL)
+        return error;
+
+    if(*cursor != '\0')
+        return "Malformed attack vector string, see usage";
+
+    attack_vector->def_string     = def_string;
+    attack_vector->units_on_front = units_on_front;
+
+    return NULL;
+}
+
+static inline void
+SplitBranchUnits (
+                  struct dice_rules         rules,
+                  struct attack_vector_def* attack_vector,
+                  unsigned int              units_on_front,
+                  unsigned int*             branch_fronts
+                 )
+{
+    unsigned int branch_count;
+    unsigned int available_units;
+    unsigned int assigned_units;
+    uint64_t     total_weight;
+
+    /*
+     Every unit free to move is handed to the branches in proportion to the enemies each has to
+     beat, evenly when none have any, and the rounding remainder goes to the first branches.  Every
+     branch attacks from the shared territory, so each front also counts the units staying behind.
+     */
+    branch_count    = attack_vector->branch_count;
+    available_units = units_on_front > rules.min_territory_units ? units_on_front-rules.min_territory_units : 0;
+    assigned_units  = 0;
+    total_weight    = 0;
+
+    for(unsigned int index = 0; index < branch_count; index++)
+        total_weight += attack_vector->branches[index].subtree_enemy_units;
+
+    for(unsigned int index = 0; index < branch_count; index++)
+    {
+        uint64_t     weight;
+        unsigned int share;
+
+        weight = total_weight > 0 ? attack_vector->branches[index].subtree_enemy_units : 1;
+        share  = (unsigned int)(available_units*weight/(total_weight > 0 ? total_weight : branch_count));
+
+        branch_fronts[index]  = share+rules.min_territory_units;
+        assigned_units       += share;
+    }
+
+    for(unsigned int index = 0; assigned_units < available_units; index++, assigned_units++)
+        branch_fronts[index]++;
+}
+
+static inline char*
+ParseQuery (struct arena* arena, int arg_count, char** args, struct war_query* query)
+{
+    char* error;
+    char* end;
+
+    if(arg_count <= program_arg_attack_vector)
+        return "Missing query arguments, see usage";
+
+    /* strtoull takes signs and leading spaces and saturates on overflow, so only bare digits are let through */
+    errno                 = 0;
+    query->sim_iterations = strtoull(args[program_arg_sim_iterations], &end, 10);
+    if(
+       args[program_arg_sim_iterations][0] < '0' ||
+       args[program_arg_sim_iterations][0] > '9' ||
+       *end != '\0' ||
+       errno == ERANGE
+      )
+        return "Malformed simulation iterations, see usage";
+
+    if(query->sim_iterations > MAX_SIM_ITERATIONS)
+        return "Too many simulation iterations, at most 2^48";
+
+    query->bonus_units          = (unsigned int)atoi(args[program_arg_bonus_units]);
+    query->likelihood_threshold = (float)atof(args[program_arg_likelihood_threshold]);
+
+    if(query->bonus_units > MAX_PLAN_BONUS_UNITS)
+        return "Too many bonus units to plan with";
+
+    query->attack_vectors      = ArenaAlloc(arena, (arg_count-program_arg_attack_vector)*sizeof(struct attack_vector_def));
+    query->attack_vector_count = 0;
+
+    for(int index = program_arg_attack_vector; index < arg_count; index++)
+    {
+        error = ParseAttackVector(arena, args[index], &query->attack_vectors[query->attack_vector_count]);
+        if(error != NULL)
+            return error;
+
+        query->attack_vector_count++;
+    }
+
+    return NULL;
+}
+
+static inline char**
+SplitQueryArgs (struct arena* arena, char* line, int* arg_count)
+{
+    char** args;
+    char*  token;
+    char*  save;
+
+    /* Tokens are separated, so a line holds at most half its length of them */
+    args       = ArenaAlloc(arena, (strlen(line)/2+1)*sizeof(char*));
+    *arg_count = 0;
+
+    for(token = strtok_r(line, " \t\r", &save); token != NULL; token = strtok_r(NULL, " \t\r", &save))
+        args[(*arg_count)++] = token;
+
+    return args;
+}
+
+static inline void
+PrintPrediction (char* vector_def_string, struct attack_prediction* prediction)
+{
+    printf("Attack vector '%s' prediction\n", vector_def_string);
+
+    if(prediction->win_count+prediction->loss_count > 0)
+    {
+        printf(
+               "\tWin count: %llu Loss count: %llu\n",
+               (unsigned long long)prediction->win_count,
+               (unsigned long long)prediction->loss_count
+              );
+        printf(
+               "\tStandard errors: win %.2e units %.2e territories %.2e enemies %.2e\n",
+               prediction->win_likelihood_error,
+               prediction->remaining_units_if_win_error,
+               prediction->remaining_territories_if_loss_error,
+               prediction->remaining_enemies_if_loss_error
+              );
+    }
+    else
+        printf("\tExact solution\n");
+
+    if(prediction->win_likelihood > 0)
+    {
+        printf(
+               "\tWin likelihood: %.2f with %.2f units remaning\n",
+               prediction->win_likelihood,
+               prediction->estimated_remaining_units_if_win
+              );
+    }
+    else
+        printf("\tWin likelihood: 0 this is a debo move\n");
+
+    if(prediction->win_likelihood < 1)
+    {
+        printf(
+               "\t\tIf loss, %.2f remaining territories with %.2f enemies total\n",
+               prediction->estimated_remaining_enemies_if_loss,
+               prediction->estimated_remaining_territories_if_loss
+              );
+    }
+}
+
+static inline void
+PrintSetup (struct attack_setup* setup)
+{
+    char* def_string;
+
+    def_string = setup->attack_vector->def_string;
+
+    printf(
+           "%u bonus armies to attack vector '%s'\n",
+           setup->bonus,
+           def_string
+          );
+    PrintPrediction(def_string, &setup->prediction);
+}
+
+static inline void
+PrintCurve (struct attack_setup* row, unsigned int bonus_units)
+{
+    struct attack_vector_def* attack_vector;
+
+    attack_vector = row->attack_vector;
+
+    printf("Attack vector '%s' win likelihood curve\n", attack_vector->def_string);
+
+    for(unsigned int bonus = 0; bonus <= bonus_units; bonus++)
+    {
+        struct attack_prediction* prediction;
+
+        prediction = &row[bonus].prediction;
+
+        printf(
+               "\t%u units on front: win %.4f with %.2f units remaining\n",
+               attack_vector->units_on_front+bonus,
+               prediction->win_likelihood,
+               prediction->win_likelihood > 0 ? prediction->estimated_remaining_units_if_win : 0
+              );
+    }
+
+    printf("\n");
+}
+
+static inline void
+WritePrediction (FILE* stream, struct attack_vector_def* attack_vector, unsigned int bonus, struct attack_prediction* prediction)
+{
+    fprintf(
+            stream,
+            " vector=%s bonus=%u win=%.6f units=%.4f territories=%.4f enemies=%.4f"
+            " win_se=%.6f units_se=%.4f territories_se=%.4f enemies_se=%.4f",
+            attack_vector->def_string,
+            bonus,
+            prediction->win_likelihood,
+            prediction->win_likelihood > 0 ? prediction->estimated_remaining_units_if_win : 0,
+            prediction->win_likelihood < 1 ? prediction->estimated_remaining_territories_if_loss : 0,
+            prediction->win_likelihood < 1 ? prediction->estimated_remaining_enemies_if_loss : 0,
+            prediction->win_likelihood_error,
+            prediction->remaining_units_if_win_error,
+            prediction->remaining_territories_if_loss_error,
+            prediction->remaining_enemies_if_loss_error
+           );
+}
+
+static int
+CompareDice (const void* left, const void* right)
+{
+    unsigned int left_value;
+    unsigned int right_value;
+    int          delta;
+
+    left_value  = *(unsigned int*)left;
+    right_value = *(unsigned int*)right;
+
+    delta = (int)right_value-(int)left_value;
+
+    return delta;
+}
+
+static int
+ComparePlan (const void* left, const void* right)
+{
+    const struct attack_plan* left_plan;
+    const struct attack_plan* right_plan;
+
+    left_plan  = left;
+    right_plan = right;
+
+    if(right_plan->total_score > left_plan->total_score)
+        return 1;
+    else if(right_plan->total_score < left_plan->total_score)
+        return -1;
+
+    return 0;
+}
+
+static inline uint64_t
+MixSeed (uint64_t value)
+{
+    value += 0x9E3779B97F4A7C15ull;
+    value  = (value^(value >> 30))*0xBF58476D1CE4E5B9ull;
+    value  = (value^(value >> 27))*0x94D049BB133111EBull;
+
+    return value^(value >> 31);
+}
+
+static inline void
+SeedSimContext (struct sim_context* sim, uint64_t stream, uint64_t substream)
+{
+    uint64_t seed;
+
+    seed = MixSeed(MixSeed(run_seed^stream)^substream);
+
+    for(size_t index = 0; index < RANDOM_STATE_SIZE; index++)
+    {
+        seed                     += index;
+        sim->random_state[index]  = MixSeed(seed);
+    }
+
+    sim->antithetic_mask       = 0;
+    sim->has_spare_random_bits = 0;
+}
+
+static inline uint64_t
+BattleKey (unsigned int front_units, unsigned int territory_units)
+{
+    return ((uint64_t)front_units << 32)|territory_units;
+}
+
+static inline uint64_t
+RotateLeft (uint64_t value, unsigned int shift)
+{
+    return (value << shift)|(value >> (64-shift));
+}
+
+static inline uint64_t
+RandomNext64 (struct sim_context* sim)
+{
+    uint64_t* state;
+    uint64_t  result;
+    uint64_t  shifted;
+
+    /* xoshiro256** */
+    state   = sim->random_state;
+    result  = RotateLeft(state[1]*5, 7)*9;
+    shifted = state[1] << 17;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= shifted;
+    state[3]  = RotateLeft(state[3], 45);
+
+    /* An antithetic stream flips every bit, mirroring each uniform draw about the middle of its range */
+    return result^sim->antithetic_mask;
+}
+
+static inline uint32_t
+RandomNext32 (struct sim_context* sim)
+{
+    uint64_t bits;
+
+    if(sim->has_spare_random_bits)
+    {
+        sim->has_spare_random_bits = 0;
+
+        return sim->spare_random_bits;
+    }
+
+    bits = RandomNext64(sim);
+
+    sim->spare_random_bits     = (uint32_t)bits;
+    sim->has_spare_random_bits = 1;
+
+    return (uint32_t)(bits >> 32);
+}
+
+__attribute__((always_inline))
+static inline uint32_t
+RandomBounded (struct sim_context* sim, uint32_t range)
+{
+    uint64_t product;
+    uint32_t low_bits;
+
+    /* Lemire's multiply and reject, the rare rejection keeps the result unbiased */
+    product  = (uint64_t)RandomNext32(sim)*range;
+    low_bits = (uint32_t)product;
+
+    if(low_bits < range)
+    {
+        uint32_t threshold;
+
+        threshold = -range%range;
+
+        while(low_bits < threshold)
+        {
+            product  = (uint64_t)RandomNext32(sim)*range;
+            low_bits = (uint32_t)product;
+        }
+    }
+
+    return (uint32_t)(product >> 32);
+}
+
+static inline unsigned int
+UniformDiceRoll (struct sim_context* sim, struct dice_rules rules)
+{
+    return RandomBounded(sim, rules.dice_sides)+1;
+}
+
+static inline unsigned int
+UniformRoll (struct sim_context* sim, unsigned int roll_count)
+{
+    return RandomBounded(sim, roll_count);
+}
+
+__attribute__((always_inline))
+static inline void
+RollDice (struct sim_context* sim, struct dice_rules rules, unsigned int* dice, unsigned int count)
+{
+    unsigned int roll_count;
+    unsigned int digits;
+
+    roll_count = 1;
+    for(size_t index = count; index-- > 0;)
+        roll_count *= rules.dice_sides;
+
+    /* One draw covers every die, each die is a base dice_sides digit of it */
+    digits = UniformRoll(sim, roll_count);
+
+    for(size_t index = count; index-- > 0;)
+    {
+        dice[index]  = (digits%rules.dice_sides)+1;
+        digits      /= rules.dice_sides;
+    }
+
+    qsort(dice, count, sizeof(unsigned int), &CompareDice);
+
+    sim->dice_rolled += count;
+}
+
+static inline void
+CompareRolledDice (
+                   unsigned int* attack_dice,
+                   unsigned int* defend_dice,
+                   unsigned int  compare_dice_count,
+                   unsigned int* lost_attack_units,
+                   unsigned int* lost_defend_units
+                  )
+{
+    *lost_attack_units = 0;
+    *lost_defend_units = 0;
+
+    for(unsigned int index = 0; index < compare_dice_count; index++)
+    {
+        if(attack_dice[index] > defend_dice[index])
+            (*lost_defend_units)++;
+        else
+            (*lost_attack_units)++;
+    }
+}
+
+static inline void
+InitRollOutcomes (void)
+{
+    roll_table_count = 1;
+    for(unsigned int index = run_rules.attack_dice_count+run_rules.defend_dice_count; index-- > 0;)
+        roll_table_count *= run_rules.dice_sides;
+
+    for(unsigned int index = 0; index < MAX_COMPARE_DICE_COUNT; index++)
+    {
+        for(unsigned int combination = 0; combination < ROLL_COMBINATION_COUNT; combination++)
+            roll_outcome_thresholds[index][combination] = roll_table_count;
+    }
+
+    for(unsigned int attack_dice_count = 1; attack_dice_count <= run_rules.attack_dice_count; attack_dice_count++)
+    {
+        for(unsigned int defend_dice_count = 1; defend_dice_count <= run_rules.defend_dice_count; defend_dice_count++)
+        {
+            struct roll_outcomes* outcomes;
+            unsigned int          compare_dice_count;
+            unsigned int          roll_count;
+            unsigned int          cumulative_roll_count;
+
+            outcomes           = &roll_outcome_table[attack_dice_count][defend_dice_count];
+            compare_dice_count = MIN(attack_dice_count, defend_dice_count);
+
+            roll_count = 1;
+            for(unsigned int index = attack_dice_count+defend_dice_count; index-- > 0;)
+                roll_count *= run_rules.dice_sides;
+
+            outcomes->outcome_count = compare_dice_count+1;
+            outcomes->roll_count    = roll_count;
+
+            for(unsigned int index = 0; index < outcomes->outcome_count; index++)
+            {
+                outcomes->outcomes[index].lost_attack_units = index;
+                outcomes->outcomes[index].lost_defend_units = compare_dice_count-index;
+                outcomes->outcomes[index].roll_count        = 0;
+            }
+
+            /* Every roll is enumerated as a base dice_sides number, one digit per die */
+            for(unsigned int roll = 0; roll < roll_count; roll++)
+            {
+                unsigned int attack_dice[MAX_DICE_COUNT];
+                unsigned int defend_dice[MAX_DICE_COUNT];
+                unsigned int digits;
+                unsigned int lost_attack_units;
+                unsigned int lost_defend_units;
+
+                digits = roll;
+
+                for(unsigned int index = 0; index < attack_dice_count; index++, digits /= run_rules.dice_sides)
+                    attack_dice[index] = (digits%run_rules.dice_sides)+1;
+
+                for(unsigned int index = 0; index < defend_dice_count; index++, digits /= run_rules.dice_sides)
+                    defend_dice[index] = (digits%run_rules.dice_sides)+1;
+
+                qsort(attack_dice, attack_dice_count, sizeof(unsigned int), &CompareDice);
+                qsort(defend_dice, defend_dice_count, sizeof(unsigned int), &CompareDice);
+
+                CompareRolledDice(
+                                  attack_dice,
+                                  defend_dice,
+                                  compare_dice_count,
+                                  &lost_attack_units,
+                                  &lost_defend_units
+                                 );
+
+                outcomes->outcomes[lost_attack_units].roll_count++;
+            }
+
+            cumulative_roll_count                = 0;
+            outcomes->expected_lost_attack_units = 0;
+
+            for(unsigned int index = 0; index < outcomes->outcome_count; index++)
+            {
+                struct roll_outcome* outcome;
+
+                outcome = &outcomes->outcomes[index];
+
+                cumulative_roll_count += outcome->roll_count;
+
+                outcome->cumulative_roll_count = cumulative_roll_count;
+                outcome->likelihood            = (double)outcome->roll_count/(double)roll_count;
+
+                outcomes->expected_lost_attack_units += outcome->likelihood*outcome->lost_attack_units;
+
+                if(index < MAX_COMPARE_DICE_COUNT)
+                {
+                    unsigned int combination;
+
+                    combination = attack_dice_count*(MAX_DEFEND_DICE_COUNT+1)+defend_dice_count;
+
+                    roll_outcome_thresholds[index][combination] = cumulative_roll_count*(roll_table_count/roll_count);
+                }
+            }
+        }
+    }
+}
+
+__attribute__((always_inline))
+static inline void
+SingleAttack (
+              struct sim_context* sim,
+              struct dice_rules   rules,
+              unsigned int        units_on_front,
+              unsigned int        territory_units,
+              unsigned int*       remaining_units_on_front,
+              unsigned int*       remaining_territory_units
              )
 {
-    unsigned int attack_dice[MAX_DICE_COUNT];
-    unsigned int defend_dice[MAX_DICE_COUNT];
-    unsigned int attack_unit_count;
-    unsigned int attack_dice_count;
-    unsigned int defend_unit_count;
-    unsigned int defend_dice_count;
-    unsigned int compare_dice_count;
-    unsigned int lost_attack_units;
-    unsigned int lost_defend_units;
+    unsigned int attack_dice[MAX_DICE_COUNT];
+    unsigned int defend_dice[MAX_DICE_COUNT];
+    unsigned int attack_unit_count;
+    unsigned int attack_dice_count;
+    unsigned int defend_unit_count;
+    unsigned int defend_dice_count;
+    unsigned int compare_dice_count;
+    unsigned int lost_attack_units;
+    unsigned int lost_defend_units;
+
+    attack_unit_count = units_on_front-rules.min_territory_units;
+    attack_dice_count = MIN(attack_unit_count, rules.attack_dice_count);
+
+    defend_unit_count = territory_units;
+    defend_dice_count = MIN(defend_unit_count, rules.defend_dice_count);
+
+    RollDice(sim, rules, attack_dice, attack_dice_count);
+    RollDice(sim, rules, defend_dice, defend_dice_count);
+
+    sim->single_attacks++;
+
+    compare_dice_count = MIN(attack_dice_count, defend_dice_count);
+
+    CompareRolledDice(
+                      attack_dice,
+                      defend_dice,
+                      compare_dice_count,
+                      &lost_attack_units,
+                      &lost_defend_units
+                     );
+
+    TRACE(
+          sim,
+          trace_dice,
+          PackDice(attack_dice, attack_dice_count, defend_dice, defend_dice_count),
+          units_on_front,
+          territory_units
+         );
+    TRACE(sim, trace_losses, 0, lost_attack_units, lost_defend_units);
+
+    sim->control_units += lost_attack_units-roll_outcome_table[attack_dice_count][defend_dice_count].expected_lost_attack_units;
+
+    *remaining_units_on_front  = units_on_front-lost_attack_units;
+    *remaining_territory_units = territory_units-lost_defend_units;
+}
+
+__attribute__((always_inline))
+static inline void
+SingleAttackSampled (
+                     struct sim_context* sim,
+                     struct dice_rules   rules,
+                     unsigned int        units_on_front,
+                     unsigned int        territory_units,
+                     unsigned int*       remaining_units_on_front,
+                     unsigned int*       remaining_territory_units
+                    )
+{
+    struct roll_outcomes* outcomes;
+    struct roll_outcome*  outcome;
+    unsigned int          attack_dice_count;
+    unsigned int          defend_dice_count;
+    unsigned int          roll;
+
+    attack_dice_count = MIN(units_on_front-rules.min_territory_units, rules.attack_dice_count);
+    defend_dice_count = MIN(territory_units, rules.defend_dice_count);
+
+    outcomes = &roll_outcome_table[attack_dice_count][defend_dice_count];
+
+    /* A single uniform roll index selects the outcome whose cumulative roll count covers it */
+    roll    = UniformRoll(sim, outcomes->roll_count);
+    outcome = outcomes->outcomes;
+
+    while(roll >= outcome->cumulative_roll_count)
+        outcome++;
+
+    sim->single_attacks++;
+    sim->dice_rolled += attack_dice_count+defend_dice_count;
+
+    TRACE(sim, trace_losses, 0, outcome->lost_attack_units, outcome->lost_defend_units);
+
+    sim->control_units += outcome->lost_attack_units-outcomes->expected_lost_attack_units;
+
+    *remaining_units_on_front  = units_on_front-outcome->lost_attack_units;
+    *remaining_territory_units = territory_units-outcome->lost_defend_units;
+}
+
+static inline void
+ResolveTerritoryExact (
+                       double*      front_likelihoods,
+                       unsigned int front_limit,
+                       unsigned int territory_units,
+                       double*      scratch_rows,
+                       double*      loss_likelihoods
+                      )
+{
+    double* rows[EXACT_ROW_COUNT];
+    size_t  row_size;
+
+    /*
+     Every roll removes at least one unit from the battle, so mass only ever flows towards fewer
+     defenders or, within a row, towards fewer front units.  Sweeping defender rows downwards and
+     front units downwards within each row visits every state after all of its predecessors, and
+     only EXACT_ROW_COUNT rows are ever live at once.
+
+     On return front_likelihoods holds the distribution of front units remaining after a win, and
+     loss_likelihoods[units] the likelihood of the front being exhausted with units defenders left.
+     */
+
+    if(territory_units == 0)
+        return;
+
+    row_size = (front_limit+1)*sizeof(double);
+
+    for(size_t index = 0; index < EXACT_ROW_COUNT; index++)
+    {
+        rows[index] = &scratch_rows[index*(front_limit+1)];
+        memset(rows[index], 0, row_size);
+    }
+
+    memcpy(rows[territory_units%EXACT_ROW_COUNT], front_likelihoods, row_size);
+
+    for(unsigned int defend_units = territory_units; defend_units > 0; defend_units--)
+    {
+        double*      row;
+        double       loss_likelihood;
+        unsigned int defend_dice_count;
+
+        row               = rows[defend_units%EXACT_ROW_COUNT];
+        defend_dice_count = MIN(defend_units, run_rules.defend_dice_count);
+
+        for(unsigned int front_units = front_limit; front_units > run_rules.min_territory_units; front_units--)
+        {
+            struct roll_outcomes* outcomes;
+            double                likelihood;
+            unsigned int          attack_dice_count;
+
+            likelihood = row[front_units];
+            if(likelihood == 0)
+                continue;
+
+            attack_dice_count = MIN(front_units-run_rules.min_territory_units, run_rules.attack_dice_count);
+            outcomes          = &roll_outcome_table[attack_dice_count][defend_dice_count];
+
+            for(unsigned int index = 0; index < outcomes->outcome_count; index++)
+            {
+                struct roll_outcome* outcome;
+                double*              next_row;
+
+                outcome  = &outcomes->outcomes[index];
+                next_row = rows[(defend_units-outcome->lost_defend_units)%EXACT_ROW_COUNT];
+
+                next_row[front_units-outcome->lost_attack_units] += likelihood*outcome->likelihood;
+            }
+        }
+
+        loss_likelihood = 0;
+        for(unsigned int front_units = 0; front_units <= MIN(front_limit, run_rules.min_territory_units); front_units++)
+            loss_likelihood += row[front_units];
+
+        loss_likelihoods[defend_units] = loss_likelihood;
+
+        memset(row, 0, row_size);
+    }
+
+    memcpy(front_likelihoods, rows[0], row_size);
+}
+
+static inline void
+BuildAliasTable (double* likelihoods, unsigned int count, double* acceptances, uint32_t* aliases)
+{
+    uint32_t* small;
+    uint32_t* large;
+    size_t    small_count;
+    size_t    large_count;
+
+    /* Vose's alias method, each column keeps its own outcome with acceptances[index] or takes its alias */
+    small = malloc(2*count*sizeof(uint32_t));
+    if(small == NULL)
+        Abort("Failed to alloc memory for alias table");
+
+    large       = &small[count];
+    small_count = 0;
+    large_count = 0;
+
+    for(unsigned int index = 0; index < count; index++)
+    {
+        acceptances[index] = likelihoods[index]*count;
+        aliases[index]     = index;
+
+        if(acceptances[index] < 1)
+            small[small_count++] = index;
+        else
+            large[large_count++] = index;
+    }
+
+    while(small_count > 0 && large_count > 0)
+    {
+        uint32_t small_index;
+        uint32_t large_index;
+
+        small_index = small[--small_count];
+        large_index = large[large_count-1];
+
+        aliases[small_index]      = large_index;
+        acceptances[large_index] -= 1-acceptances[small_index];
+
+        if(acceptances[large_index] < 1)
+        {
+            large_count--;
+            small[small_count++] = large_index;
+        }
+    }
+
+    /* Whatever is left over only misses 1 through rounding */
+    while(large_count > 0)
+        acceptances[large[--large_count]] = 1;
+
+    while(small_count > 0)
+        acceptances[small[--small_count]] = 1;
+
+    free(small);
+}
+
+static inline double
+ResolveBattleLikelihoods (
+                          unsigned int front_units,
+                          unsigned int territory_units,
+                          double*      front_likelihoods,
+                          double*      scratch_rows,
+                          double*      likelihoods
+                         )
+{
+    unsigned int win_outcome_count;
+    double       win_likelihood;
+
+    /*
+     Outcomes [0, win_outcome_count) are wins with min_territory_units+1+index front units left,
+     the rest are losses with index-win_outcome_count+1 defenders left.  likelihoods needs room
+     for one more than the outcome count.
+     */
+    win_outcome_count = front_units-run_rules.min_territory_units;
+
+    memset(front_likelihoods, 0, (front_units+1)*sizeof(double));
+    front_likelihoods[front_units] = 1;
+
+    /* Loss likelihoods land one slot early so that they line up after the wins */
+    ResolveTerritoryExact(
+                          front_likelihoods,
+                          front_units,
+                          territory_units,
+                          scratch_rows,
+                          &likelihoods[win_outcome_count-1]
+                         );
+
+    win_likelihood = 0;
+
+    for(unsigned int index = 0; index < win_outcome_count; index++)
+    {
+        likelihoods[index]  = front_likelihoods[run_rules.min_territory_units+1+index];
+        win_likelihood     += likelihoods[index];
+    }
+
+    return win_likelihood;
+}
+
+static inline struct battle_outcomes*
+BuildBattleOutcomes (unsigned int front_units, unsigned int territory_units)
+{
+    struct battle_outcomes* outcomes;
+    double*                 front_likelihoods;
+    double*                 scratch_rows;
+    double*                 likelihoods;
+    unsigned int            win_outcome_count;
+    unsigned int            outcome_count;
+    size_t                  size;
+
+    win_outcome_count = front_units-run_rules.min_territory_units;
+    outcome_count     = win_outcome_count+territory_units;
+
+    size     = sizeof(struct battle_outcomes)+outcome_count*(sizeof(double)+sizeof(uint32_t));
+    outcomes = malloc(size);
+
+    front_likelihoods = malloc((front_units+1)*sizeof(double));
+    scratch_rows      = malloc(EXACT_ROW_COUNT*(front_units+1)*sizeof(double));
+    likelihoods       = malloc((outcome_count+1)*sizeof(double));
+    if(outcomes == NULL || front_likelihoods == NULL || scratch_rows == NULL || likelihoods == NULL)
+        Abort("Failed to alloc memory for battle outcomes");
+
+    outcomes->key               = BattleKey(front_units, territory_units);
+    outcomes->size              = size;
+    outcomes->win_outcome_count = win_outcome_count;
+    outcomes->outcome_count     = outcome_count;
+    outcomes->acceptances       = (double*)&outcomes[1];
+    outcomes->aliases           = (uint32_t*)&outcomes->acceptances[outcome_count];
+
+    outcomes->win_likelihood = ResolveBattleLikelihoods(
+                                                        front_units,
+                                                        territory_units,
+                                                        front_likelihoods,
+                                                        scratch_rows,
+                                                        likelihoods
+                                                       );
+
+    BuildAliasTable(likelihoods, outcome_count, outcomes->acceptances, outcomes->aliases);
+
+    free(likelihoods);
+    free(scratch_rows);
+    free(front_likelihoods);
+
+    return outcomes;
+}
+
+static inline void
+LoadBattleTable (struct battle_table* table, char* path)
+{
+    struct battle_table_header* header;
+    struct stat                 file_stat;
+    size_t                      entry_count;
+    int                         fd;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+        Abort("Failed to open battle table");
+
+    if(fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(struct battle_table_header))
+        Abort("Battle table is too small");
+
+    table->mapping_size = (size_t)file_stat.st_size;
+    table->mapping      = mmap(NULL, table->mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(table->mapping == MAP_FAILED)
+        Abort("Failed to map battle table");
+
+    close(fd);
+
+    header = (struct battle_table_header*)table->mapping;
+    if(memcmp(header->magic, BATTLE_TABLE_MAGIC, sizeof(header->magic)) != 0)
+        Abort("Not a WarPlan battle table");
+
+    if(header->version != BATTLE_TABLE_VERSION)
+        Abort("Battle table version is not supported, regenerate it with warplan-gentable");
+
+    if(memcmp(&header->rules, &run_rules, sizeof(run_rules)) != 0)
+        Abort("Battle table was generated for other dice rules, see --rules");
+
+    entry_count = (size_t)(header->max_front_units-run_rules.min_territory_units)*header->max_territory_units;
+
+    if(
+       header->max_front_units <= run_rules.min_territory_units ||
+       header->entry_count != entry_count ||
+       header->file_size != table->mapping_size ||
+       header->entry_offset%sizeof(uint64_t) != 0 ||
+       header->entry_offset > header->likelihood_offset ||
+       (header->likelihood_offset-header->entry_offset)/sizeof(struct battle_table_entry) < entry_count ||
+       header->likelihood_offset > table->mapping_size
+      )
+        Abort("Battle table is malformed or truncated");
+
+    table->header  = header;
+    table->entries = (struct battle_table_entry*)&table->mapping[header->entry_offset];
+
+    /* Entries are read blindly while simulating, so every likelihood run must lie within the mapping */
+    for(unsigned int front_units = run_rules.min_territory_units+1; front_units <= header->max_front_units; front_units++)
+    {
+        for(unsigned int territory_units = 1; territory_units <= header->max_territory_units; territory_units++)
+        {
+            uint64_t     offset;
+            unsigned int outcome_count;
+
+            offset        = table->entries[
+                                           (size_t)(front_units-run_rules.min_territory_units-1)*header->max_territory_units+
+                                           territory_units-1
+                                          ].likelihood_offset;
+            outcome_count = front_units-run_rules.min_territory_units+territory_units;
+
+            if(
+               offset%sizeof(double) != 0 ||
+               offset < header->likelihood_offset ||
+               offset > table->mapping_size ||
+               (table->mapping_size-offset)/sizeof(double) < outcome_count
+              )
+                Abort("Battle table is malformed or truncated");
+        }
+    }
+}
+
+static inline void
+UnloadBattleTable (struct battle_table* table)
+{
+    munmap(table->mapping, table->mapping_size);
+
+    table->header = NULL;
+}
+
+static inline struct battle_table_entry*
+FindTableBattle (unsigned int front_units, unsigned int territory_units)
+{
+    struct battle_table_header* header;
+
+    header = run_table.header;
+
+    if(
+       !(run_flags&enable_battle_table) ||
+       front_units <= run_rules.min_territory_units ||
+       front_units > header->max_front_units ||
+       territory_units == 0 ||
+       territory_units > header->max_territory_units
+      )
+        return NULL;
+
+    return &run_table.entries[(size_t)(front_units-run_rules.min_territory_units-1)*header->max_territory_units+territory_units-1];
+}
+
+static inline int
+TableCoversVector (struct attack_vector_def* attack_vector, unsigned int bonus_units)
+{
+    if(!(run_flags&enable_battle_table) || attack_vector->branch_count > 0)
+        return 0;
+
+    if(attack_vector->units_on_front+bonus_units > run_table.header->max_front_units)
+        return 0;
+
+    for(unsigned int index = 0; index < attack_vector->territory_count; index++)
+    {
+        if(attack_vector->territory_vector[index].units > run_table.header->max_territory_units)
+            return 0;
+    }
+
+    return 1;
+}
+
+static inline void
+ResolveTerritoryTable (
+                       double*      front_likelihoods,
+                       unsigned int front_limit,
+                       unsigned int territory_units,
+                       double*      next_likelihoods,
+                       double*      loss_likelihoods
+                      )
+{
+    /* Same contract as ResolveTerritoryExact, each front size is spread over its table entry's outcomes */
+    if(territory_units == 0)
+        return;
+
+    memset(next_likelihoods, 0, (front_limit+1)*sizeof(double));
+    memset(loss_likelihoods, 0, (territory_units+1)*sizeof(double));
+
+    for(unsigned int front_units = 0; front_units <= front_limit; front_units++)
+    {
+        struct battle_table_entry* entry;
+        double*                    likelihoods;
+        double                     likelihood;
+        unsigned int               win_outcome_count;
+
+        likelihood = front_likelihoods[front_units];
+        if(likelihood == 0)
+            continue;
+
+        if(front_units <= run_rules.min_territory_units)
+        {
+            loss_likelihoods[territory_units] += likelihood;
+
+            continue;
+        }
+
+        entry             = FindTableBattle(front_units, territory_units);
+        likelihoods       = (double*)&run_table.mapping[entry->likelihood_offset];
+        win_outcome_count = front_units-run_rules.min_territory_units;
+
+        for(unsigned int index = 0; index < win_outcome_count; index++)
+            next_likelihoods[run_rules.min_territory_units+1+index] += likelihood*likelihoods[index];
+
+        for(unsigned int index = 0; index < territory_units; index++)
+            loss_likelihoods[index+1] += likelihood*likelihoods[win_outcome_count+index];
+    }
+
+    memcpy(front_likelihoods, next_likelihoods, (front_limit+1)*sizeof(double));
+}
+
+static inline void
+InitBattleMemo (struct battle_memo* memo, size_t byte_budget)
+{
+    size_t slot_count;
+
+    slot_count = BATTLE_MEMO_MIN_SLOTS;
+    while(slot_count*BATTLE_MEMO_BYTES_PER_SLOT < byte_budget)
+        slot_count *= 2;
+
+    memo->slots = calloc(slot_count, sizeof(struct battle_outcomes*));
+    if(memo->slots == NULL)
+        Abort("Failed to alloc memory for battle memo");
+
+    CountAllocation(slot_count*sizeof(struct battle_outcomes*));
+
+    memo->slot_count  = slot_count;
+    memo->entry_count = 0;
+    memo->byte_count  = slot_count*sizeof(struct battle_outcomes*);
+    memo->byte_budget = byte_budget;
+
+    pthread_mutex_init(&memo->lock, NULL);
+}
+
+static inline void
+DestroyBattleMemo (struct battle_memo* memo)
+{
+    for(size_t index = 0; index < memo->slot_count; index++)
+        free(memo->slots[index]);
+
+    pthread_mutex_destroy(&memo->lock);
+
+    free(memo->slots);
+}
+
+static inline struct battle_outcomes*
+FindBattleOutcomes (
+                    struct battle_memo* memo,
+                    struct sim_context* sim,
+                    unsigned int        front_units,
+                    unsigned int        territory_units
+                   )
+{
+    struct battle_outcomes* outcomes;
+    uint64_t                key;
+    size_t                  mask;
+    size_t                  slot;
+
+    /*
+     Entries are only ever added, never moved or freed while simulating, so readers probe
+     without locking and only see fully built entries thanks to the release/acquire pair on
+     the slot pointer.  Builders race outside the lock and the loser frees its copy.  The
+     limits are only a hint outside the lock and are checked again before inserting.
+     */
+
+    key  = BattleKey(front_units, territory_units);
+    mask = memo->slot_count-1;
+
+    for(slot = MixSeed(key)&mask;; slot = (slot+1)&mask)
+    {
+        outcomes = __atomic_load_n(&memo->slots[slot], __ATOMIC_ACQUIRE);
+        if(outcomes == NULL)
+            break;
+
+        if(outcomes->key == key)
+        {
+            sim->memo_hits++;
+
+            return outcomes;
+        }
+    }
+
+    sim->memo_misses++;
+
+    if(
+       __atomic_load_n(&memo->byte_count, __ATOMIC_RELAXED) >= memo->byte_budget ||
+       __atomic_load_n(&memo->entry_count, __ATOMIC_RELAXED)*2 >= memo->slot_count
+      )
+        return NULL;
+
+    outcomes = BuildBattleOutcomes(front_units, territory_units);
+
+    pthread_mutex_lock(&memo->lock);
+
+    for(;; slot = (slot+1)&mask)
+    {
+        struct battle_outcomes* existing;
+
+        existing = memo->slots[slot];
+        if(existing == NULL)
+        {
+            /* Other builders may have filled the memo since the unlocked check */
+            if(memo->byte_count >= memo->byte_budget || memo->entry_count*2 >= memo->slot_count)
+            {
+                free(outcomes);
+
+                outcomes = NULL;
+
+                break;
+            }
+
+            __atomic_store_n(&memo->slots[slot], outcomes, __ATOMIC_RELEASE);
+            __atomic_store_n(&memo->entry_count, memo->entry_count+1, __ATOMIC_RELAXED);
+            __atomic_store_n(&memo->byte_count, memo->byte_count+outcomes->size, __ATOMIC_RELAXED);
+
+            CountAllocation(outcomes->size);
+
+            break;
+        }
+
+        if(existing->key == key)
+        {
+            free(outcomes);
+
+            outcomes = existing;
+
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&memo->lock);
+
+    return outcomes;
+}
+
+__attribute__((always_inline))
+static inline uint32_t
+SampleAlias (struct sim_context* sim, double* acceptances, uint32_t* aliases, unsigned int count)
+{
+    uint32_t index;
+    double   coin;
+
+    index = RandomBounded(sim, count);
+    coin  = (double)(RandomNext64(sim) >> 11)*0x1.0p-53;
+
+    if(coin >= acceptances[index])
+        index = aliases[index];
+
+    return index;
+}
+
+__attribute__((always_inline))
+static inline void
+SampleBattleOutcome (
+                     struct sim_context*     sim,
+                     struct dice_rules       rules,
+                     struct battle_outcomes* outcomes,
+                     unsigned int*           remaining_units_on_front,
+                     unsigned int*           remaining_territory_units
+                    )
+{
+    uint32_t index;
+
+    index = SampleAlias(sim, outcomes->acceptances, outcomes->aliases, outcomes->outcome_count);
+
+    if(index < outcomes->win_outcome_count)
+    {
+        *remaining_units_on_front  = rules.min_territory_units+1+index;
+        *remaining_territory_units = 0;
+    }
+    else
+    {
+        *remaining_units_on_front  = rules.min_territory_units;
+        *remaining_territory_units = index-outcomes->win_outcome_count+1;
+    }
+}
+
+static inline void
+PrintBattleMemoStats (FILE* stream, struct battle_memo* memo)
+{
+    uint64_t hits;
+    uint64_t misses;
+
+    hits   = 0;
+    misses = 0;
+
+    for(unsigned int index = 0; index < run_pool.worker_count; index++)
+    {
+        hits   += run_pool.workers[index].sim.memo_hits;
+        misses += run_pool.workers[index].sim.memo_misses;
+    }
+
+    fprintf(
+            stream,
+            "\nBattle memo: %llu hits, %llu misses, %zu entries using %zu of %zu bytes\n",
+            (unsigned long long)hits,
+            (unsigned long long)misses,
+            memo->entry_count,
+            memo->byte_count,
+            memo->byte_budget
+           );
+}
+
+static inline void
+PrintRunStats (FILE* stream)
+{
+    uint64_t dice_rolled;
+    uint64_t single_attacks;
+
+    dice_rolled    = 0;
+    single_attacks = 0;
+
+    for(unsigned int index = 0; index < run_pool.worker_count; index++)
+    {
+        dice_rolled    += run_pool.workers[index].sim.dice_rolled;
+        single_attacks += run_pool.workers[index].sim.single_attacks;
+    }
+
+    fprintf(
+            stream,
+            "\nRun stats:\n"
+            "\tTrials: %llu\n"
+            "\tExact predictions: %llu\n"
+            "\tCurve sweeps: %llu\n"
+            "\tSingle attacks: %llu\n"
+            "\tDice rolled: %llu\n"
+            "\tPlan candidates: %llu\n"
+            "\tPlans kept: %llu\n"
+            "\tBytes allocated: %llu\n",
+            (unsigned long long)run_stats.trials,
+            (unsigned long long)run_stats.exact_predictions,
+            (unsigned long long)run_stats.curve_sweeps,
+            (unsigned long long)single_attacks,
+            (unsigned long long)dice_rolled,
+            (unsigned long long)run_stats.plan_candidates,
+            (unsigned long long)run_stats.plans_kept,
+            (unsigned long long)run_stats.bytes_allocated
+           );
+
+    for(size_t phase = 0; phase < phase_count; phase++)
+        fprintf(stream, "\t%s seconds: %.6f\n", run_phase_names[phase], run_stats.phase_seconds[phase]);
+}
+
+static inline void
+InitFastForward (void)
+{
+    struct roll_outcomes* full_round;
+    double*               likelihoods;
+    double*               squared;
+    unsigned int          compare_dice_count;
+
+    /*
+     While both sides roll every die they may, every round removes exactly as many units as dice
+     are compared and rounds are independent, so the attacking losses over 2k rounds are the
+     losses over k rounds convolved with themselves.  Squaring up from a single round gives every
+     power of two.
+     */
+    compare_dice_count = MIN(run_rules.attack_dice_count, run_rules.defend_dice_count);
+    full_round         = &roll_outcome_table[run_rules.attack_dice_count][run_rules.defend_dice_count];
+    likelihoods        = calloc(2*compare_dice_count << (FAST_FORWARD_LEVEL_COUNT-1), sizeof(double));
+    squared            = calloc(2*compare_dice_count << (FAST_FORWARD_LEVEL_COUNT-1), sizeof(double));
+    if(likelihoods == NULL || squared == NULL)
+        Abort("Failed to alloc memory for fast forward tables");
+
+    for(unsigned int index = 0; index < full_round->outcome_count; index++)
+        likelihoods[full_round->outcomes[index].lost_attack_units] = full_round->outcomes[index].likelihood;
+
+    for(unsigned int level = 0; level < FAST_FORWARD_LEVEL_COUNT; level++)
+    {
+        struct fast_forward_level* fast_forward;
+        unsigned int               outcome_count;
+
+        fast_forward  = &fast_forward_levels[level];
+        outcome_count = (compare_dice_count << level)+1;
+
+        fast_forward->round_count   = 1 << level;
+        fast_forward->outcome_count = outcome_count;
+        fast_forward->acceptances   = malloc(outcome_count*sizeof(double));
+        fast_forward->aliases       = malloc(outcome_count*sizeof(uint32_t));
+        if(fast_forward->acceptances == NULL || fast_forward->aliases == NULL)
+            Abort("Failed to alloc memory for fast forward tables");
+
+        CountAllocation(outcome_count*(sizeof(double)+sizeof(uint32_t)));
+
+        BuildAliasTable(likelihoods, outcome_count, fast_forward->acceptances, fast_forward->aliases);
+
+        if(level+1 == FAST_FORWARD_LEVEL_COUNT)
+            break;
+
+        memset(squared, 0, (2*outcome_count-1)*sizeof(double));
+
+        for(unsigned int left = 0; left < outcome_count; left++)
+        {
+            for(unsigned int right = 0; right < outcome_count; right++)
+                squared[left+right] += likelihoods[left]*likelihoods[right];
+        }
+
+        memcpy(likelihoods, squared, (2*outcome_count-1)*sizeof(double));
+    }
+
+    free(squared);
+    free(likelihoods);
+}
+
+__attribute__((always_inline))
+static inline void
+FastForwardBattle (
+                   struct sim_context* sim,
+                   struct dice_rules   rules,
+                   unsigned int*       front_units,
+                   unsigned int*       territory_units
+                  )
+{
+    unsigned int full_attack_units;
+    unsigned int compare_dice_count;
+
+    full_attack_units  = rules.min_territory_units+rules.attack_dice_count;
+    compare_dice_count = MIN(rules.attack_dice_count, rules.defend_dice_count);
+
+    /*
+     A jump of k rounds is exact as long as both sides would still roll every die before the
+     last of them even if they lost every unit along the way.  Jumps take the largest power of
+     two that fits, so each one covers at least a quarter of the remaining full strength rounds.
+     */
+    while(*front_units >= full_attack_units && *territory_units >= rules.defend_dice_count)
+    {
+        struct fast_forward_level* fast_forward;
+        unsigned int               round_count;
+        unsigned int               level;
+        unsigned int               lost_attack_units;
+        unsigned int               lost_units;
+
+        round_count = MIN(
+                          (*front_units-full_attack_units)/compare_dice_count,
+                          (*territory_units-rules.defend_dice_count)/compare_dice_count
+                         )+1;
+
+        if(round_count < 2)
+            break;
+
+        level = 0;
+        while(level+1 < FAST_FORWARD_LEVEL_COUNT && 2u << level <= round_count)
+            level++;
+
+        fast_forward = &fast_forward_levels[level];
+
+        lost_attack_units = SampleAlias(
+                                        sim,
+                                        fast_forward->acceptances,
+                                        fast_forward->aliases,
+                                        fast_forward->outcome_count
+                                       );
+        lost_units        = compare_dice_count*fast_forward->round_count;
+
+        *front_units     -= lost_attack_units;
+        *territory_units -= lost_units-lost_attack_units;
+
+        sim->single_attacks += fast_forward->round_count;
+        sim->dice_rolled    += fast_forward->round_count*(rules.attack_dice_count+rules.defend_dice_count);
+
+        TRACE(sim, trace_fast_forward, fast_forward->round_count, lost_attack_units, lost_units-lost_attack_units);
+    }
+}
+
+__attribute__((always_inline))
+static inline void
+AttackTerritory (
+                 struct sim_context*   sim,
+                 struct dice_rules     rules,
+                 unsigned int          units_on_front,
+                 struct territory_def* territory,
+                 unsigned int*         remaining_units_on_front,
+                 unsigned int*         remaining_territory_units
+                )
+{
+    unsigned int front_units;
+    unsigned int territory_units;
+
+    front_units     = units_on_front;
+    territory_units = territory->units;
+
+    if(run_flags&enable_dice_rolls)
+    {
+        while(front_units > rules.min_territory_units && territory_units > 0)
+        {
+            SingleAttack(
+                         sim,
+                         rules,
+                         front_units,
+                         territory_units,
+                         &front_units,
+                         &territory_units
+                        );
+        }
+    }
+    else
+    {
+        if(run_flags&enable_battle_memo && front_units > rules.min_territory_units && territory_units > 0)
+        {
+            struct battle_outcomes* outcomes;
+
+            /* A full memo falls back to rolling the battle out */
+            outcomes = FindBattleOutcomes(&run_memo, sim, front_units, territory_units);
+            if(outcomes != NULL)
+            {
+                SampleBattleOutcome(sim, rules, outcomes, &front_units, &territory_units);
+
+                TRACE(sim, trace_battle, 0, front_units, territory_units);
+            }
+        }
+
+        if(run_flags&enable_fast_forward)
+            FastForwardBattle(sim, rules, &front_units, &territory_units);
+
+        while(front_units > rules.min_territory_units && territory_units > 0)
+        {
+            SingleAttackSampled(
+                                sim,
+                                rules,
+                                front_units,
+                                territory_units,
+                                &front_units,
+                                &territory_units
+                               );
+        }
+    }
+
+    *remaining_units_on_front  = front_units;
+    *remaining_territory_units = territory_units;
+}
+
+__attribute__((always_inline))
+static inline void
+SimAttack (
+           struct sim_context*       sim,
+           struct dice_rules         rules,
+           struct attack_vector_def* attack_vector,
+           unsigned int              units_on_front,
+           struct attack_result*     result
+          )
+{
+    struct territory_def* territory_cursor;
+    struct territory_def* territory_vector;
+    unsigned int          remaining_units_on_front;
+    unsigned int          remaining_territory_units;
+
+    territory_vector          = attack_vector->territory_vector;
+    remaining_territory_units = 0;
+
+    territory_cursor = territory_vector;
+
+    for(unsigned int size = attack_vector->territory_count; size-- > 0;)
+    {
+        TRACE(sim, trace_territory, 0, units_on_front, territory_cursor->units);
+
+        AttackTerritory(
+                        sim,
+                        rules,
+                        units_on_front,
+                        territory_cursor,
+                        &remaining_units_on_front,
+                        &remaining_territory_units
+                       );
+
+        if(remaining_territory_units == 0)
+        {
+            units_on_front = remaining_units_on_front-rules.min_territory_units;
+
+            TRACE(sim, trace_conquered, 0, (uint32_t)(territory_cursor-territory_vector), units_on_front);
+        }
+        else
+        {
+            units_on_front = remaining_units_on_front;
+
+            TRACE(sim, trace_failed, 0, units_on_front, remaining_territory_units);
+
+            break;
+        }
+
+        territory_cursor++;
+    }
+
+    result->conquered_territory_count = territory_cursor-territory_vector;
+    result->units_on_front            = units_on_front;
+    result->enemy_units_on_front      = remaining_territory_units;
+}
+
+/*
+ A branching vector plays its chain out like any other and then splits the survivors over its
+ branches.  Each edge is simulated once per trial, so a trial costs the size of the tree rather
+ than the sum of its root to leaf paths.  Branches recurse through simulate_branch, the
+ ruleset's own copy of this walk.
+ */
+__attribute__((always_inline))
+static inline void
+SimAttackTree (
+               struct sim_context*       sim,
+               struct dice_rules         rules,
+               tree_kernel               simulate_branch,
+               struct attack_vector_def* attack_vector,
+               unsigned int              units_on_front,
+               struct tree_result*       result
+              )
+{
+    struct attack_result chain_result;
+
+    SimAttack(sim, rules, attack_vector, units_on_front, &chain_result);
+
+    if(chain_result.enemy_units_on_front > 0)
+    {
+        unsigned int conquered_territory_count;
+
+        conquered_territory_count = chain_result.conquered_territory_count;
+
+        result->enemy_units_remaining += chain_result.enemy_units_on_front+
+                                         attack_vector->enemy_units_after[conquered_territory_count];
+        result->territories_remaining += attack_vector->subtree_territory_count-conquered_territory_count;
+    }
+    else if(attack_vector->branch_count == 0)
+        result->units_on_front += chain_result.units_on_front;
+    else
+    {
+        unsigned int branch_fronts[attack_vector->branch_count];
+
+        SplitBranchUnits(rules, attack_vector, chain_result.units_on_front, branch_fronts);
+
+        for(unsigned int index = 0; index < attack_vector->branch_count; index++)
+            simulate_branch(sim, &attack_vector->branches[index], branch_fronts[index], result);
+    }
+}
+
+static inline void
+AddRunningStats (struct running_stats* stats, double value)
+{
+    double deviation;
+
+    stats->count++;
+
+    deviation                  = value-stats->mean;
+    stats->mean               += deviation/stats->count;
+    stats->squared_deviations += deviation*(value-stats->mean);
+}
+
+static inline void
+MergeRunningStats (struct running_stats* stats, struct running_stats* other_stats)
+{
+    uint64_t count;
+    double   deviation;
+
+    if(other_stats->count == 0)
+        return;
+
+    count     = stats->count+other_stats->count;
+    deviation = other_stats->mean-stats->mean;
+
+    stats->mean               += deviation*other_stats->count/count;
+    stats->squared_deviations += other_stats->squared_deviations+
+                                 deviation*deviation*((double)stats->count*other_stats->count/count);
+    stats->count               = count;
+}
+
+static inline double
+RunningStandardError (struct running_stats* stats)
+{
+    if(stats->count < 2)
+        return 0;
+
+    return sqrt(stats->squared_deviations/(stats->count-1)/stats->count);
+}
+
+__attribute__((always_inline))
+static inline void
+SimulateTrials (
+                struct sim_context*       sim,
+                tree_kernel               simulate_tree,
+                struct attack_vector_def* attack_vector,
+                unsigned int              bonus_units,
+                unsigned int              sim_iterations,
+                struct prediction_tally*  tally
+               )
+{
+    for(size_t remaining = sim_iterations; remaining-- > 0;)
+    {
+        struct tree_result result;
+
+        TRACE(sim, trace_trial, 0, attack_vector->units_on_front+bonus_units, attack_vector->subtree_territory_count);
+
+        result.units_on_front        = 0;
+        result.enemy_units_remaining = 0;
+        result.territories_remaining = 0;
+        sim->control_units           = 0;
+
+        simulate_tree(sim, attack_vector, attack_vector->units_on_front+bonus_units, &result);
+
+        tally->control_sum        += sim->control_units;
+        tally->control_square_sum += sim->control_units*sim->control_units;
+
+        if(result.territories_remaining == 0)
+        {
+            tally->win_count++;
+            tally->win_control_sum += sim->control_units;
+
+            AddRunningStats(&tally->units_on_front, result.units_on_front);
+        }
+        else
+        {
+            tally->loss_count++;
+
+            AddRunningStats(&tally->enemy_units_remaining, result.enemy_units_remaining);
+            AddRunningStats(&tally->territories_remaining, result.territories_remaining);
+        }
+    }
+}
+
+static inline void
+MergeTally (struct prediction_tally* tally, struct prediction_tally* chunk_tally)
+{
+    tally->win_count          += chunk_tally->win_count;
+    tally->loss_count         += chunk_tally->loss_count;
+    tally->control_sum        += chunk_tally->control_sum;
+    tally->control_square_sum += chunk_tally->control_square_sum;
+    tally->win_control_sum    += chunk_tally->win_control_sum;
+
+    MergeRunningStats(&tally->units_on_front, &chunk_tally->units_on_front);
+    MergeRunningStats(&tally->enemy_units_remaining, &chunk_tally->enemy_units_remaining);
+    MergeRunningStats(&tally->territories_remaining, &chunk_tally->territories_remaining);
+}
+
+static inline void
+FinishPrediction (struct prediction_tally* tally, struct attack_prediction* prediction)
+{
+    double trial_count;
+    double win_likelihood;
+    double win_variance;
+
+    trial_count    = (double)(tally->win_count+tally->loss_count);
+    win_likelihood = trial_count > 0 ? tally->win_count/trial_count : 0;
+    win_variance   = win_likelihood*(1-win_likelihood);
+
+    /*
+     Surplus attacking losses have zero mean and pull strongly against winning, so the win
+     likelihood is corrected by its regression on them, with the coefficient fitted to the trials,
+     and only the variance the regression leaves unexplained counts towards its error
+     */
+    if(run_flags&enable_control && trial_count > 1)
+    {
+        double control_mean;
+        double control_variance;
+
+        control_mean     = tally->control_sum/trial_count;
+        control_variance = tally->control_square_sum/trial_count-control_mean*control_mean;
+
+        if(control_variance > 0)
+        {
+            double covariance;
+            double coefficient;
+
+            covariance      = tally->win_control_sum/trial_count-win_likelihood*control_mean;
+            coefficient     = covariance/control_variance;
+            win_likelihood  = MIN(MAX(win_likelihood-coefficient*control_mean, 0), 1);
+            win_variance    = MAX(win_variance-covariance*coefficient, 0);
+        }
+    }
+
+    prediction->win_likelihood                          = (float)win_likelihood;
+    prediction->estimated_remaining_units_if_win        = (float)tally->units_on_front.mean;
+    prediction->estimated_remaining_enemies_if_loss     = (float)tally->enemy_units_remaining.mean;
+    prediction->estimated_remaining_territories_if_loss = (float)tally->territories_remaining.mean;
+    prediction->win_likelihood_error                    = trial_count > 0 ? (float)sqrt(win_variance/trial_count) : 0;
+    prediction->remaining_units_if_win_error            = (float)RunningStandardError(&tally->units_on_front);
+    prediction->remaining_enemies_if_loss_error         = (float)RunningStandardError(&tally->enemy_units_remaining);
+    prediction->remaining_territories_if_loss_error     = (float)RunningStandardError(&tally->territories_remaining);
+    prediction->win_count                               = tally->win_count;
+    prediction->loss_count                              = tally->loss_count;
+}
+
+/*
+ Lane helpers take and hand back vectors through pointers and are always inlined, so no vector
+ is ever passed by value across a call, whose ABI depends on whether AVX is enabled
+ */
+__attribute__((always_inline))
+static inline int
+LaneMaskAny (lane_mask* mask)
+{
+    int32_t any;
+
+    any = 0;
+    for(size_t lane = 0; lane < BATCH_LANE_COUNT; lane++)
+        any |= (*mask)[lane];
+
+    return any != 0;
+}
+
+__attribute__((always_inline))
+static inline void
+LaneMin (lane_units* result, lane_units* left, lane_units* right)
+{
+    lane_units select_left;
+
+    select_left = (lane_units)(*left < *right);
+
+    *result = (*left&select_left)|(*right&~select_left);
+}
+
+static inline void
+SeedBatchContext (struct batch_context* batch, uint64_t stream, uint64_t substream)
+{
+    for(size_t lane = 0; lane < BATCH_LANE_COUNT; lane++)
+    {
+        struct sim_context lane_sim;
+
+        SeedSimContext(&lane_sim, stream, MixSeed(substream)^lane);
+
+        for(size_t index = 0; index < RANDOM_STATE_SIZE; index++)
+            batch->random_state[index][lane] = (uint32_t)lane_sim.random_state[index];
+    }
+
+    batch->antithetic_mask = (lane_units){0};
+    batch->attack_counts   = (lane_units){0};
+    batch->dice_counts     = (lane_units){0};
+}
+
+__attribute__((always_inline))
+static inline void
+BatchRandomNext (struct batch_context* batch, lane_units* bits)
+{
+    lane_units* state;
+    lane_units  result;
+    lane_units  shifted;
+    lane_units  scaled;
+
+    /* xoshiro128** in every lane, the multiplies by 5 and 9 are spelled as shifts for the vector unit */
+    state   = batch->random_state;
+    scaled  = (state[1] << 2)+state[1];
+    scaled  = (scaled << 7)|(scaled >> 25);
+    result  = (scaled << 3)+scaled;
+    shifted = state[1] << 9;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= shifted;
+    state[3]  = (state[3] << 11)|(state[3] >> 21);
+
+    *bits = result^batch->antithetic_mask;
+}
+
+__attribute__((always_inline))
+static inline void
+BatchUniformRolls (struct batch_context* batch, lane_units* rolls, lane_units* low_bits)
+{
+    lane_units bits;
+    lane_units low_product;
+    lane_units middle_product;
+
+    /*
+     Lemire's multiply and reject needs the full 48 bit product of a 32 bit draw and the 16 bit
+     roll count, built here from the two 16 bit halves of the draw so every lane stays 32 bits
+     */
+    BatchRandomNext(batch, &bits);
+
+    low_product    = (bits&0xFFFF)*roll_table_count;
+    middle_product = (bits >> 16)*roll_table_count+(low_product >> 16);
+
+    *rolls    = middle_product >> 16;
+    *low_bits = (middle_product << 16)|(low_product&0xFFFF);
+}
+
+__attribute__((always_inline))
+static inline void
+ResolveBatchLanes (
+                   struct dice_rules         rules,
+                   lane_mask*                finished,
+                   struct attack_vector_def* attack_vector,
+                   unsigned int              starting_units,
+                   unsigned int*             trials_remaining,
+                   lane_units*               front_units,
+                   lane_units*               territory_units,
+                   lane_units*               territory_index,
+                   lane_mask*                active,
+                   struct prediction_tally*  tally
+                  )
+{
+    struct territory_def* territories;
+    unsigned int          territory_count;
+
+    territories     = attack_vector->territory_vector;
+    territory_count = attack_vector->territory_count;
+
+    for(size_t lane = 0; lane < BATCH_LANE_COUNT; lane++)
+    {
+        if(!(*finished)[lane])
+            continue;
+
+        /* A lane can conquer, lose or start over several times before it needs another roll */
+        for(;;)
+        {
+            if((*territory_units)[lane] == 0)
+            {
+                (*territory_index)[lane]++;
+
+                if((*territory_index)[lane] < territory_count)
+                {
+                    (*front_units)[lane]     -= rules.min_territory_units;
+                    (*territory_units)[lane]  = territories[(*territory_index)[lane]].units;
+
+                    continue;
+                }
+
+                tally->win_count++;
+
+                AddRunningStats(&tally->units_on_front, (*front_units)[lane]-rules.min_territory_units);
+            }
+            else if((*front_units)[lane] <= rules.min_territory_units)
+            {
+                unsigned int index;
+
+                index = (*territory_index)[lane];
+
+                tally->loss_count++;
+
+                AddRunningStats(&tally->enemy_units_remaining, (*territory_units)[lane]+attack_vector->enemy_units_after[index]);
+                AddRunningStats(&tally->territories_remaining, territory_count-index);
+            }
+            else
+                break;
+
+            if(*trials_remaining == 0)
+            {
+                (*active)[lane]          = 0;
+                (*front_units)[lane]     = rules.min_territory_units+1;
+                (*territory_units)[lane] = 1;
+
+                break;
+            }
+
+            (*trials_remaining)--;
+
+            (*front_units)[lane]     = starting_units;
+            (*territory_units)[lane] = territories[0].units;
+            (*territory_index)[lane] = 0;
+        }
+    }
+}
+
+__attribute__((always_inline))
+static inline void
+SimulateTrialBatch (
+                    struct batch_context*     batch,
+                    struct dice_rules         rules,
+                    struct attack_vector_def* attack_vector,
+                    unsigned int              bonus_units,
+                    unsigned int              sim_iterations,
+                    struct prediction_tally*  tally
+                   )
+{
+    struct territory_def* territories;
+    unsigned int          trials_remaining;
+    uint32_t              roll_rejection_threshold;
+    lane_units            attack_dice_limits;
+    lane_units            defend_dice_limits;
+    lane_units            front_units;
+    lane_units            territory_units;
+    lane_units            territory_index;
+    lane_mask             active;
+    lane_mask             finished;
+
+    territories = attack_vector->territory_vector;
+
+    roll_rejection_threshold = -roll_table_count%roll_table_count;
+
+    attack_dice_limits = (lane_units){0}+rules.attack_dice_count;
+    defend_dice_limits = (lane_units){0}+rules.defend_dice_count;
+
+    trials_remaining = sim_iterations;
+    front_units      = (lane_units){0};
+    territory_units  = (lane_units){0};
+    territory_index  = (lane_units){0};
+    active           = (lane_mask){0};
+
+    for(size_t lane = 0; lane < BATCH_LANE_COUNT && trials_remaining > 0; lane++, trials_remaining--)
+    {
+        active[lane]          = -1;
+        front_units[lane]     = attack_vector->units_on_front+bonus_units;
+        territory_units[lane] = territories[0].units;
+    }
+
+    /* Parked lanes sit on a state that never finishes and never changes */
+    for(size_t lane = sim_iterations; lane < BATCH_LANE_COUNT; lane++)
+    {
+        front_units[lane]     = rules.min_territory_units+1;
+        territory_units[lane] = 1;
+    }
+
+    /* Trials may finish before their first roll, empty territories or a front too small to attack */
+    finished = active;
+
+    ResolveBatchLanes(
+                      rules,
+                      &finished,
+                      attack_vector,
+                      attack_vector->units_on_front+bonus_units,
+                      &trials_remaining,
+                      &front_units,
+                      &territory_units,
+                      &territory_index,
+                      &active,
+                      tally
+                     );
+
+    while(LaneMaskAny(&active))
+    {
+        lane_units attack_units;
+        lane_units attack_dice_count;
+        lane_units defend_dice_count;
+        lane_units compare_dice_count;
+        lane_units combination;
+        lane_units rolls;
+        lane_units low_bits;
+        lane_units lost_attack_units;
+        lane_units lost_defend_units;
+        lane_mask  rejected;
+
+        attack_units = front_units-rules.min_territory_units;
+
+        LaneMin(&attack_dice_count, &attack_units, &attack_dice_limits);
+        LaneMin(&defend_dice_count, &territory_units, &defend_dice_limits);
+
+        combination = attack_dice_count*(MAX_DEFEND_DICE_COUNT+1)+defend_dice_count;
+
+        BatchUniformRolls(batch, &rolls, &low_bits);
+
+        rejected = (lane_mask)(low_bits < roll_rejection_threshold);
+
+        /* Redraw the rare lanes whose draw would bias the roll */
+        while(LaneMaskAny(&rejected))
+        {
+            lane_units retry_rolls;
+
+            BatchUniformRolls(batch, &retry_rolls, &low_bits);
+
+            rolls    = (rolls&~(lane_units)rejected)|(retry_rolls&(lane_units)rejected);
+            rejected = rejected&(lane_mask)(low_bits < roll_rejection_threshold);
+        }
+
+        /* The outcome index, and so the attacking units lost, counts the thresholds a roll passes */
+        lost_attack_units = (lane_units){0};
+        for(size_t index = 0; index < MIN(rules.attack_dice_count, rules.defend_dice_count); index++)
+        {
+            lane_units thresholds;
+
+            for(size_t lane = 0; lane < BATCH_LANE_COUNT; lane++)
+                thresholds[lane] = roll_outcome_thresholds[index][combination[lane]];
+
+            lost_attack_units -= (lane_units)(rolls >= thresholds);
+        }
+
+        LaneMin(&compare_dice_count, &attack_dice_count, &defend_dice_count);
+
+        lost_defend_units = compare_dice_count-lost_attack_units;
+
+        front_units          -= lost_attack_units&(lane_units)active;
+        territory_units      -= lost_defend_units&(lane_units)active;
+        batch->attack_counts -= (lane_units)active;
+        batch->dice_counts   += (attack_dice_count+defend_dice_count)&(lane_units)active;
+
+        finished = ((territory_units == 0)|(front_units <= rules.min_territory_units))&active;
+        if(LaneMaskAny(&finished))
+        {
+            ResolveBatchLanes(
+                              rules,
+                              &finished,
+                              attack_vector,
+                              attack_vector->units_on_front+bonus_units,
+                              &trials_remaining,
+                              &front_units,
+                              &territory_units,
+                              &territory_index,
+                              &active,
+                              tally
+                             );
+        }
+    }
+}
+
+/*
+ Each ruleset gets its own copy of the trial kernels with its rules passed down as constants, so
+ the compiler folds every rule into the hot loops.  A run looks its kernels up once, up front.
+ */
+#define RULESET_RULES(attack_dice, defend_dice, dice_sides, min_territory_units)                    \
+    ((struct dice_rules){attack_dice, defend_dice, dice_sides, min_territory_units})
+
+#define DEFINE_RULESET_KERNELS(name, attack_dice, defend_dice, dice_sides, min_territory_units)     \
+    static void                                                                                     \
+    SimAttackTree_##name (                                                                          \
+                          struct sim_context*       sim,                                            \
+                          struct attack_vector_def* attack_vector,                                  \
+                          unsigned int              units_on_front,                                 \
+                          struct tree_result*       result                                          \
+                         )                                                                          \
+    {                                                                                               \
+        SimAttackTree(                                                                              \
+                      sim,                                                                          \
+                      RULESET_RULES(attack_dice, defend_dice, dice_sides, min_territory_units),     \
+                      &SimAttackTree_##name,                                                        \
+                      attack_vector,                                                                \
+                      units_on_front,                                                               \
+                      result                                                                        \
+                     );                                                                             \
+    }                                                                                               \
+                                                                                                    \
+    static void                                                                                     \
+    SimulateTrials_##name (                                                                         \
+                           struct sim_context*       sim,                                           \
+                           struct attack_vector_def* attack_vector,                                 \
+                           unsigned int              bonus_units,                                   \
+                           unsigned int              sim_iterations,                                \
+                           struct prediction_tally*  tally                                          \
+                          )                                                                         \
+    {                                                                                               \
+        SimulateTrials(                                                                             \
+                       sim,                                                                         \
+                       &SimAttackTree_##name,                                                       \
+                       attack_vector,                                                               \
+                       bonus_units,                                                                 \
+                       sim_iterations,                                                              \
+                       tally                                                                        \
+                      );                                                                            \
+    }                                                                                               \
+                                                                                                    \
+    __attribute__((target_clones("avx2", "default")))                                               \
+    static void                                                                                     \
+    SimulateTrialBatch_##name (                                                                     \
+                               struct batch_context*     batch,                                     \
+                               struct attack_vector_def* attack_vector,                             \
+                               unsigned int              bonus_units,                               \
+                               unsigned int              sim_iterations,                            \
+                               struct prediction_tally*  tally                                      \
+                              )                                                                     \
+    {                                                                                               \
+        SimulateTrialBatch(                                                                         \
+                           batch,                                                                   \
+                           RULESET_RULES(attack_dice, defend_dice, dice_sides, min_territory_units),\
+                           attack_vector,                                                           \
+                           bonus_units,                                                             \
+                           sim_iterations,                                                          \
+                           tally                                                                    \
+                          );                                                                        \
+    }
+
+#define RULESET_NAME(name, attack_dice, defend_dice, dice_sides, min_territory_units) " " #name
+
+#define RULESET_ENTRY(name, attack_dice, defend_dice, dice_sides, min_territory_units)              \
+    {                                                                                               \
+        #name,                                                                                      \
+        RULESET_RULES(attack_dice, defend_dice, dice_sides, min_territory_units),                   \
+        &SimulateTrials_##name,                                                                     \
+        &SimulateTrialBatch_##name                                                                  \
+    },
+
+DICE_RULESETS(DEFINE_RULESET_KERNELS)
+
+static struct ruleset rulesets[] = {DICE_RULESETS(RULESET_ENTRY)};
+
+static inline void
+SelectRuleset (char* name)
+{
+    for(size_t index = 0; index < sizeof(rulesets)/sizeof(rulesets[0]); index++)
+    {
+        if(strcmp(rulesets[index].name, name) == 0)
+        {
+            run_ruleset = &rulesets[index];
+            run_rules   = rulesets[index].rules;
+
+            return;
+        }
+    }
+
+    Abort("Unknown dice rules, see usage");
+}
+
+static inline void
+PredictAttackExact (
+                    struct attack_vector_def* attack_vector,
+                    unsigned int              bonus_units,
+                    struct attack_prediction* prediction
+                   )
+{
+    struct territory_def* territory_vector;
+    double*               front_likelihoods;
+    double*               scratch_rows;
+    double*               loss_likelihoods;
+    double                win_likelihood;
+    double                loss_likelihood;
+    double                total_units_on_front;
+    double                total_enemy_units_remaining;
+    double                total_territories_remaining;
+    unsigned int          units_on_front;
+    unsigned int          front_limit;
+    unsigned int          territory_count;
+    unsigned int          enemy_units_remaining;
+    unsigned int          max_territory_units;
+
+    /* Fronts too small to attack still need room for the min_territory_units shifted off every territory */
+    units_on_front   = attack_vector->units_on_front+bonus_units;
+    front_limit      = MAX(units_on_front, run_rules.min_territory_units);
+    territory_vector = attack_vector->territory_vector;
+    territory_count  = attack_vector->territory_count;
+
+    /* A lone territory in the battle table is answered straight from its entry */
+    if(territory_count == 1)
+    {
+        struct battle_table_entry* entry;
+
+        entry = FindTableBattle(units_on_front, territory_vector[0].units);
+        if(entry != NULL)
+        {
+            prediction->win_likelihood                          = (float)entry->win_likelihood;
+            prediction->estimated_remaining_units_if_win        = (float)(entry->units_if_win-run_rules.min_territory_units);
+            prediction->estimated_remaining_enemies_if_loss     = (float)entry->defenders_if_loss;
+            prediction->estimated_remaining_territories_if_loss = 1;
+            prediction->win_likelihood_error                    = 0;
+            prediction->remaining_units_if_win_error            = 0;
+            prediction->remaining_enemies_if_loss_error         = 0;
+            prediction->remaining_territories_if_loss_error     = 0;
+            prediction->win_count                               = 0;
+            prediction->loss_count                              = 0;
+
+            return;
+        }
+    }
+
+    enemy_units_remaining = 0;
+    max_territory_units   = 0;
+
+    for(unsigned int index = 0; index < territory_count; index++)
+    {
+        enemy_units_remaining += territory_vector[index].units;
+        max_territory_units    = MAX(max_territory_units, territory_vector[index].units);
+    }
+
+    front_likelihoods = calloc(front_limit+1, sizeof(double));
+    scratch_rows      = malloc(EXACT_ROW_COUNT*(front_limit+1)*sizeof(double));
+    loss_likelihoods  = malloc((max_territory_units+1)*sizeof(double));
+    if(front_likelihoods == NULL || scratch_rows == NULL || loss_likelihoods == NULL)
+        Abort("Failed to alloc memory for exact prediction");
+
+    CountAllocation(((EXACT_ROW_COUNT+1)*(front_limit+1)+max_territory_units+1)*sizeof(double));
+
+    front_likelihoods[units_on_front] = 1;
+
+    loss_likelihood             = 0;
+    total_enemy_units_remaining = 0;
+    total_territories_remaining = 0;
+
+    for(unsigned int index = 0; index < territory_count; index++)
+    {
+        unsigned int territory_units;
+
+        territory_units        = territory_vector[index].units;
+        enemy_units_remaining -= territory_units;
+
+        /*
+         Composing table entries costs about front_limit/2+territory_units per front size against
+         3*territory_units for solving the battle, so small territories behind big fronts are solved
+         */
+        if(front_limit < 4*territory_units && FindTableBattle(front_limit, territory_units) != NULL)
+        {
+            ResolveTerritoryTable(
+                                  front_likelihoods,
+                                  front_limit,
+                                  territory_units,
+                                  scratch_rows,
+                                  loss_likelihoods
+                                 );
+        }
+        else
+        {
+            ResolveTerritoryExact(
+                                  front_likelihoods,
+                                  front_limit,
+                                  territory_units,
+                                  scratch_rows,
+                                  loss_likelihoods
+                                 );
+        }
+
+        for(unsigned int units = 1; units <= territory_units; units++)
+        {
+            double likelihood;
+
+            likelihood = loss_likelihoods[units];
+
+            loss_likelihood             += likelihood;
+            total_enemy_units_remaining += likelihood*(units+enemy_units_remaining);
+            total_territories_remaining += likelihood*(territory_count-index);
+        }
+
+        /* Survivors move into the conquered territory, leaving min_territory_units behind */
+        memmove(
+                front_likelihoods,
+                &front_likelihoods[run_rules.min_territory_units],
+                (front_limit+1-run_rules.min_territory_units)*sizeof(double)
+               );
+        memset(
+               &front_likelihoods[front_limit+1-run_rules.min_territory_units],
+               0,
+               run_rules.min_territory_units*sizeof(double)
+              );
+    }
+
+    win_likelihood       = 0;
+    total_units_on_front = 0;
+
+    for(unsigned int units = 0; units <= front_limit; units++)
+    {
+        win_likelihood       += front_likelihoods[units];
+        total_units_on_front += front_likelihoods[units]*units;
+    }
+
+    prediction->win_likelihood                          = (float)win_likelihood;
+    prediction->estimated_remaining_units_if_win        = 0;
+    prediction->estimated_remaining_enemies_if_loss     = 0;
+    prediction->estimated_remaining_territories_if_loss = 0;
+    prediction->win_likelihood_error                    = 0;
+    prediction->remaining_units_if_win_error            = 0;
+    prediction->remaining_enemies_if_loss_error         = 0;
+    prediction->remaining_territories_if_loss_error     = 0;
+    prediction->win_count                               = 0;
+    prediction->loss_count                              = 0;
+
+    if(win_likelihood > 0)
+        prediction->estimated_remaining_units_if_win = (float)(total_units_on_front/win_likelihood);
+
+    if(loss_likelihood > 0)
+    {
+        prediction->estimated_remaining_enemies_if_loss     = (float)(total_enemy_units_remaining/loss_likelihood);
+        prediction->estimated_remaining_territories_if_loss = (float)(total_territories_remaining/loss_likelihood);
+    }
+
+    free(loss_likelihoods);
+    free(scratch_rows);
+    free(front_likelihoods);
+}
+
+/*
+ Trees are solved backwards, every node once over every front size it could be handed.  A node's
+ value after its chain is its leaf win or the fold of its branches' values, and each territory of
+ its chain is then peeled off last to first, so no path is ever replayed from the root.
+ */
+static inline void
+ResolveTreeValues (struct attack_vector_def* attack_vector, unsigned int front_limit, struct exact_value* values)
+{
+    struct exact_value* rows[EXACT_ROW_COUNT];
+    struct exact_value* scratch_rows;
+    size_t              row_size;
+
+    row_size = (front_limit+1)*sizeof(struct exact_value);
+
+    if(attack_vector->branch_count == 0)
+    {
+        for(unsigned int units = 0; units <= front_limit; units++)
+            values[units] = (struct exact_value){1, units, 0, 0};
+    }
+    else
+    {
+        struct exact_value* branch_values;
+        unsigned int        branch_count;
+
+        branch_count  = attack_vector->branch_count;
+        branch_values = malloc(branch_count*row_size);
+        if(branch_values == NULL)
+            Abort("Failed to alloc memory for exact prediction");
+
+        CountAllocation(branch_count*row_size);
+
+        for(unsigned int index = 0; index < branch_count; index++)
+            ResolveTreeValues(&attack_vector->branches[index], front_limit, &branch_values[index*(front_limit+1)]);
+
+        /* Branches are independent, a win needs all of them and a loss leaves the sum of what each left */
+        for(unsigned int units = 0; units <= front_limit; units++)
+        {
+            unsigned int       branch_fronts[branch_count];
+            struct exact_value value;
+
+            SplitBranchUnits(run_rules, attack_vector, units, branch_fronts);
+
+            value = (struct exact_value){1, 0, 0, 0};
+
+            for(unsigned int index = 0; index < branch_count; index++)
+            {
+                struct exact_value* branch_value;
+
+                branch_value = &branch_values[index*(front_limit+1)+branch_fronts[index]];
+
+                value.units_on_front         = value.units_on_front*branch_value->win_likelihood+
+                                               branch_value->units_on_front*value.win_likelihood;
+                value.win_likelihood        *= branch_value->win_likelihood;
+                value.enemy_units_remaining += branch_value->enemy_units_remaining;
+                value.territories_remaining += branch_value->territories_remaining;
+            }
+
+            values[units] = value;
+        }
+
+        free(branch_values);
+    }
+
+    if(attack_vector->territory_count == 0)
+        return;
+
+    scratch_rows = malloc(EXACT_ROW_COUNT*row_size);
+    if(scratch_rows == NULL)
+        Abort("Failed to alloc memory for exact prediction");
+
+    CountAllocation(EXACT_ROW_COUNT*row_size);
+
+    for(size_t index = 0; index < EXACT_ROW_COUNT; index++)
+        rows[index] = &scratch_rows[index*(front_limit+1)];
+
+    for(size_t index = attack_vector->territory_count; index-- > 0;)
+    {
+        unsigned int territory_units;
+
+        territory_units = attack_vector->territory_vector[index].units;
+
+        /* A taken territory hands the survivors, less min_territory_units, on to what follows it */
+        for(unsigned int units = 0; units <= front_limit; units++)
+            rows[0][units] = values[units > run_rules.min_territory_units ? units-run_rules.min_territory_units : 0];
+
+        for(unsigned int defend_units = 1; defend_units <= territory_units; defend_units++)
+        {
+            struct exact_value* row;
+            unsigned int        defend_dice_count;
+
+            row               = rows[defend_units%EXACT_ROW_COUNT];
+            defend_dice_count = MIN(defend_units, run_rules.defend_dice_count);
+
+            for(unsigned int units = 0; units <= MIN(front_limit, run_rules.min_territory_units); units++)
+            {
+                row[units] = (struct exact_value){
+                                                  0,
+                                                  0,
+                                                  defend_units+attack_vector->enemy_units_after[index],
+                                                  attack_vector->subtree_territory_count-index
+                                                 };
+            }
+
+            /* Every roll costs at least one unit, so a row only reads rows below it or fronts smaller than its own */
+            for(unsigned int units = run_rules.min_territory_units+1; units <= front_limit; units++)
+            {
+                struct roll_outcomes* outcomes;
+                struct exact_value    value;
+                unsigned int          attack_dice_count;
+
+                attack_dice_count = MIN(units-run_rules.min_territory_units, run_rules.attack_dice_count);
+                outcomes          = &roll_outcome_table[attack_dice_count][defend_dice_count];
+
+                value = (struct exact_value){0, 0, 0, 0};
+
+                for(unsigned int outcome_index = 0; outcome_index < outcomes->outcome_count; outcome_index++)
+                {
+                    struct roll_outcome* outcome;
+                    struct exact_value*  next_value;
+                    double               likelihood;
+
+                    outcome    = &outcomes->outcomes[outcome_index];
+                    likelihood = outcome->likelihood;
+                    next_value = &rows[(defend_units-outcome->lost_defend_units)%EXACT_ROW_COUNT]
+                                      [units-outcome->lost_attack_units];
+
+                    value.win_likelihood        += likelihood*next_value->win_likelihood;
+                    value.units_on_front        += likelihood*next_value->units_on_front;
+                    value.enemy_units_remaining += likelihood*next_value->enemy_units_remaining;
+                    value.territories_remaining += likelihood*next_value->territories_remaining;
+                }
+
+                row[units] = value;
+            }
+        }
+
+        memcpy(values, rows[territory_units%EXACT_ROW_COUNT], row_size);
+    }
+
+    free(scratch_rows);
+}
+
+static inline void
+ResolveExactPrediction (struct exact_value* value, struct attack_prediction* prediction)
+{
+    double loss_likelihood;
+
+    loss_likelihood = 1-value->win_likelihood;
+
+    prediction->win_likelihood                          = (float)value->win_likelihood;
+    prediction->estimated_remaining_units_if_win        = 0;
+    prediction->estimated_remaining_enemies_if_loss     = 0;
+    prediction->estimated_remaining_territories_if_loss = 0;
+    prediction->win_likelihood_error                    = 0;
+    prediction->remaining_units_if_win_error            = 0;
+    prediction->remaining_enemies_if_loss_error         = 0;
+    prediction->remaining_territories_if_loss_error     = 0;
+    prediction->win_count                               = 0;
+    prediction->loss_count                              = 0;
+
+    if(value->win_likelihood > 0)
+        prediction->estimated_remaining_units_if_win = (float)(value->units_on_front/value->win_likelihood);
+
+    if(loss_likelihood > 0)
+    {
+        prediction->estimated_remaining_enemies_if_loss     = (float)(value->enemy_units_remaining/loss_likelihood);
+        prediction->estimated_remaining_territories_if_loss = (float)(value->territories_remaining/loss_likelihood);
+    }
+}
+
+static inline void
+PredictTreeExact (
+                  struct attack_vector_def* attack_vector,
+                  unsigned int              bonus_units,
+                  struct attack_prediction* prediction
+                 )
+{
+    struct exact_value* values;
+    unsigned int        units_on_front;
+    unsigned int        front_limit;
+
+    units_on_front = attack_vector->units_on_front+bonus_units;
+    front_limit    = MAX(units_on_front, run_rules.min_territory_units);
+
+    values = malloc((front_limit+1)*sizeof(struct exact_value));
+    if(values == NULL)
+        Abort("Failed to alloc memory for exact prediction");
+
+    CountAllocation((front_limit+1)*sizeof(struct exact_value));
+
+    ResolveTreeValues(attack_vector, front_limit, values);
+
+    ResolveExactPrediction(&values[units_on_front], prediction);
+
+    free(values);
+}
+
+static inline int
+TakeTask (struct task_range* range, size_t* task_index)
+{
+    int taken;
+
+    pthread_mutex_lock(&range->lock);
+
+    taken = range->next_task < range->end_task;
+    if(taken)
+        *task_index = range->next_task++;
+
+    pthread_mutex_unlock(&range->lock);
+
+    return taken;
+}
+
+static inline int
+StealTasks (struct thread_pool* pool, struct worker* thief)
+{
+    for(unsigned int offset = 1; offset < pool->worker_count; offset++)
+    {
+        struct task_range* victim_range;
+        size_t             stolen_begin;
+        size_t             stolen_end;
+
+        victim_range = &pool->workers[(thief->index+offset)%pool->worker_count].range;
+
+        pthread_mutex_lock(&victim_range->lock);
+
+        /* Take the back half of the victim's remaining tasks, the victim keeps working from the front */
+        stolen_end   = victim_range->end_task;
+        stolen_begin = stolen_end-(stolen_end-victim_range->next_task)/2;
+        if(stolen_begin < stolen_end)
+            victim_range->end_task = stolen_begin;
+
+        pthread_mutex_unlock(&victim_range->lock);
+
+        if(stolen_begin < stolen_end)
+        {
+            pthread_mutex_lock(&thief->range.lock);
+
+            thief->range.next_task = stolen_begin;
+            thief->range.end_task  = stolen_end;
+
+            pthread_mutex_unlock(&thief->range.lock);
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static inline void
+RunWorkerTasks (struct worker* worker)
+{
+    struct thread_pool* pool;
+
+    pool = worker->pool;
+
+    do
+    {
+        size_t task_index;
+
+        while(TakeTask(&worker->range, &task_index))
+            pool->function(pool->context, task_index, &worker->sim);
+    }while(StealTasks(pool, worker));
+}
+
+static void*
+WorkerMain (void* context)
+{
+    struct worker*      worker;
+    struct thread_pool* pool;
+    unsigned int        generation;
+
+    worker     = context;
+    pool       = worker->pool;
+    generation = 0;
+
+    for(;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+
+        while(pool->generation == generation && !pool->shutting_down)
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+
+        if(pool->shutting_down)
+        {
+            pthread_mutex_unlock(&pool->lock);
+
+            return NULL;
+        }
+
+        generation = pool->generation;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        RunWorkerTasks(worker);
+
+        pthread_mutex_lock(&pool->lock);
+
+        pool->active_count--;
+        if(pool->active_count == 0)
+            pthread_cond_signal(&pool->work_done);
+
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static inline void
+InitThreadPool (struct thread_pool* pool, unsigned int worker_count)
+{
+    pool->workers = calloc(worker_count, sizeof(struct worker));
+    if(pool->workers == NULL)
+        Abort("Failed to alloc memory for workers");
+
+    pool->worker_count  = worker_count;
+    pool->generation    = 0;
+    pool->active_count  = 0;
+    pool->shutting_down = 0;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    for(unsigned int index = 0; index < worker_count; index++)
+    {
+        struct worker* worker;
+
+        worker = &pool->workers[index];
+
+        worker->pool  = pool;
+        worker->index = index;
+
+        pthread_mutex_init(&worker->range.lock, NULL);
+    }
+
+    /* The calling thread acts as worker 0 */
+    for(unsigned int index = 1; index < worker_count; index++)
+    {
+        if(pthread_create(&pool->workers[index].thread, NULL, &WorkerMain, &pool->workers[index]) != 0)
+            Abort("Failed to create worker thread");
+    }
+}
+
+static inline void
+DestroyThreadPool (struct thread_pool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    pool->shutting_down = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    for(unsigned int index = 1; index < pool->worker_count; index++)
+        pthread_join(pool->workers[index].thread, NULL);
+
+    for(unsigned int index = 0; index < pool->worker_count; index++)
+        pthread_mutex_destroy(&pool->workers[index].range.lock);
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->workers);
+}
+
+#ifdef WARPLAN_TRACE
+
+static void*  trace_mapping;
+static size_t trace_mapping_size;
+
+static inline void
+InitTrace (struct thread_pool* pool, char* path)
+{
+    struct trace_file_header* header;
+    size_t                    ring_size;
+    int                       fd;
+
+    /* The file holds a header and then one ring per worker, each worker writes its own ring */
+    ring_size          = sizeof(struct trace_ring)+TRACE_RING_RECORDS*sizeof(struct trace_record);
+    trace_mapping_size = sizeof(struct trace_file_header)+pool->worker_count*ring_size;
+
+    fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if(fd < 0)
+        Abort("Failed to open trace file");
+
+    if(ftruncate(fd, (off_t)trace_mapping_size) != 0)
+        Abort("Failed to size trace file");
+
+    trace_mapping = mmap(NULL, trace_mapping_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if(trace_mapping == MAP_FAILED)
+        Abort("Failed to map trace file");
+
+    close(fd);
+
+    header = trace_mapping;
+
+    memcpy(header->magic, TRACE_MAGIC, sizeof(header->magic));
+    header->worker_count  = pool->worker_count;
+    header->ring_capacity = TRACE_RING_RECORDS;
+
+    for(unsigned int index = 0; index < pool->worker_count; index++)
+    {
+        struct trace_ring* ring;
+
+        ring = (struct trace_ring*)((char*)&header[1]+index*ring_size);
+
+        ring->record_count = 0;
+        ring->capacity     = TRACE_RING_RECORDS;
+
+        pool->workers[index].sim.trace = ring;
+    }
+}
+
+static inline void
+FinishTrace (struct thread_pool* pool)
+{
+    for(unsigned int index = 0; index < pool->worker_count; index++)
+        pool->workers[index].sim.trace = NULL;
+
+    munmap(trace_mapping, trace_mapping_size);
+}
+
+#endif
+
+static inline void
+RunTasks (struct thread_pool* pool, size_t task_count, task_function function, void* context)
+{
+    size_t worker_count;
+
+    worker_count = pool->worker_count;
+
+    pool->function = function;
+    pool->context  = context;
+
+    /* Workers are idle between runs, so the initial even split needs no locking */
+    for(size_t index = 0; index < worker_count; index++)
+    {
+        struct task_range* range;
+
+        range = &pool->workers[index].range;
+
+        range->next_task = (task_count*index)/worker_count;
+        range->end_task  = (task_count*(index+1))/worker_count;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    pool->active_count = worker_count-1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    RunWorkerTasks(&pool->workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+
+    while(pool->active_count > 0)
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void
+RunPredictionTask (void* context, size_t task_index, struct sim_context* sim)
+{
+    struct prediction_job*   job;
+    struct prediction_cell*  cell;
+    struct prediction_tally* tally;
+    size_t                   cell_index;
+    size_t                   chunk_index;
+    unsigned int             chunk_iterations;
+    uint64_t                 stream;
+    uint64_t                 substream;
+    int                      scalar_trials;
+    int                      antithetic;
+
+    job = context;
+
+    cell_index  = job->tasks[task_index].cell_index;
+    chunk_index = job->tasks[task_index].chunk_index;
+    cell        = &job->cells[cell_index];
+    tally       = &job->tallies[task_index];
+
+    /*
+     Common random numbers give every cell the same streams, and antithetic pairs of chunks share
+     a stream with the odd chunk drawing its mirror image
+     */
+    stream     = run_flags&enable_common_random ? 0 : cell_index;
+    substream  = run_flags&enable_antithetic ? chunk_index/2 : chunk_index;
+    antithetic = run_flags&enable_antithetic && chunk_index&1;
+
+    if(run_flags&enable_exact_engine || cell->from_table)
+    {
+        if(cell->attack_vector->branch_count > 0)
+            PredictTreeExact(cell->attack_vector, cell->bonus_units, cell->prediction);
+        else
+            PredictAttackExact(cell->attack_vector, cell->bonus_units, cell->prediction);
+
+        return;
+    }
+
+    chunk_iterations = (unsigned int)MIN(
+                                         PREDICTION_CHUNK_ITERATIONS,
+                                         job->sim_iterations-chunk_index*PREDICTION_CHUNK_ITERATIONS
+                                        );
+
+    /*
+     The batch kernel walks a single chain, keeps no control sums and draws from roll tables of
+     at most MAX_BATCH_ROLL_COUNT rolls, so everything else takes the scalar path
+     */
+    scalar_trials = run_flags&(
+                               enable_dice_rolls|enable_scalar_trials|enable_battle_memo|enable_fast_forward|
+                               enable_tracing|enable_control
+                              ) || roll_table_count > MAX_BATCH_ROLL_COUNT;
+    if(scalar_trials || cell->attack_vector->branch_count > 0)
+    {
+        SeedSimContext(sim, stream, substream);
+
+        sim->antithetic_mask = antithetic ? ~(uint64_t)0 : 0;
+
+        TRACE(sim, trace_chunk, 0, (uint32_t)cell_index, (uint32_t)chunk_index);
+
+        run_ruleset->simulate_trials(
+                                     sim,
+                                     cell->attack_vector,
+                                     cell->bonus_units,
+                                     chunk_iterations,
+                                     tally
+                                    );
+    }
+    else
+    {
+        struct batch_context batch;
+
+        SeedBatchContext(&batch, stream, substream);
+
+        batch.antithetic_mask = antithetic ? ~(lane_units){0} : (lane_units){0};
+
+        run_ruleset->simulate_batch(
+                                    &batch,
+                                    cell->attack_vector,
+                                    cell->bonus_units,
+                                    chunk_iterations,
+                                    tally
+                                   );
+
+        for(size_t lane = 0; lane < BATCH_LANE_COUNT; lane++)
+        {
+            sim->single_attacks += batch.attack_counts[lane];
+            sim->dice_rolled    += batch.dice_counts[lane];
+        }
+    }
+}
+
+/*
+ A vector's value for every front size comes out of one backward sweep over its territories, so
+ a single sweep up to the largest bonus level predicts the vector's whole row of setups
+ */
+static void
+RunCurveTask (void* context, size_t task_index, struct sim_context* sim)
+{
+    struct curve_job*         job;
+    struct attack_setup*      row;
+    struct attack_vector_def* attack_vector;
+    struct exact_value*       values;
+    unsigned int              front_limit;
+
+    (void)sim;
+
+    job           = context;
+    row           = &job->setups[task_index*(job->bonus_units+1)];
+    attack_vector = row->attack_vector;
+    front_limit   = MAX(attack_vector->units_on_front+job->bonus_units, run_rules.min_territory_units);
+
+    values = malloc((front_limit+1)*sizeof(struct exact_value));
+    if(values == NULL)
+        Abort("Failed to alloc memory for exact prediction");
+
+    CountAllocation((front_limit+1)*sizeof(struct exact_value));
+
+    ResolveTreeValues(attack_vector, front_limit, values);
+
+    for(unsigned int bonus = 0; bonus <= job->bonus_units; bonus++)
+        ResolveExactPrediction(&values[attack_vector->units_on_front+bonus], &row[bonus].prediction);
+
+    free(values);
+}
+
+static inline double
+ConfidenceZScore (double confidence)
+{
+    double low;
+    double high;
+
+    /* Bisect the two sided standard normal quantile, erf is all C99 offers */
+    low  = 0;
+    high = 40;
+
+    for(unsigned int step = 0; step < 100; step++)
+    {
+        double middle;
+
+        middle = (low+high)/2;
+
+        if(erf(middle/sqrt(2)) < confidence)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return (low+high)/2;
+}
+
+static inline int
+PredictionIsPrecise (struct prediction_tally* tally, float likelihood_threshold)
+{
+    double trials;
+    double win_likelihood;
+    double z_squared;
+    double denominator;
+    double center;
+    double half_width;
+
+    trials = (double)tally->win_count+(double)tally->loss_count;
+    if(trials == 0)
+        return 0;
+
+    /* Wilson score interval of the win likelihood */
+    win_likelihood = tally->win_count/trials;
+    z_squared      = run_confidence_z*run_confidence_z;
+    denominator    = 1+z_squared/trials;
+    center         = (win_likelihood+z_squared/(2*trials))/denominator;
+    half_width     = run_confidence_z*sqrt(
+                                           win_likelihood*(1-win_likelihood)/trials+
+                                           z_squared/(4*trials*trials)
+                                          )/denominator;
+
+    if(2*half_width <= run_precision)
+        return 1;
+
+    /*
+     A setup sure to miss the threshold scores zero however precise it gets.  One sure to clear it
+     still scores its likelihood, so it keeps sampling until the interval is narrow enough.
+     */
+    if(likelihood_threshold == NO_LIKELIHOOD_THRESHOLD)
+        return 0;
+
+    return center+half_width < likelihood_threshold;
+}
+
+static inline void
+BeginShard (char* path, int arg_count, char** args)
+{
+    struct shard_file* shard;
+
+    run_shards = calloc(1, sizeof(struct shard_file));
+    if(run_shards == NULL)
+        Abort("Failed to alloc memory for shard file");
+
+    shard = &run_shards[0];
+
+    shard->stream = fopen(path, "wb");
+    if(shard->stream == NULL)
+        Abort("Failed to open shard file");
+
+    memcpy(shard->header.magic, SHARD_MAGIC, sizeof(shard->header.magic));
+
+    shard->header.version     = SHARD_VERSION;
+    shard->header.shard_index = run_shard_index;
+    shard->header.shard_count = run_shard_count;
+    shard->header.top_plans   = run_top_plans;
+    shard->header.seed        = run_seed;
+    shard->header.flags       = run_flags&SHARD_RESULT_FLAGS;
+    shard->header.query_size  = 0;
+    shard->header.cell_count  = 0;
+    shard->header.rules       = run_rules;
+
+    for(int index = 0; index < arg_count; index++)
+        shard->header.query_size += strlen(args[index])+1;
+
+    if(fwrite(&shard->header, sizeof(shard->header), 1, shard->stream) != 1)
+        Abort("Failed to write shard file");
+
+    /* The query is kept as one line of text, so a merge can parse it like any other */
+    for(int index = 0; index < arg_count; index++)
+    {
+        fputs(args[index], shard->stream);
+        fputc(index+1 < arg_count ? ' ' : '\0', shard->stream);
+    }
+}
+
+static inline void
+FinishShard (void)
+{
+    struct shard_file* shard;
+
+    shard = &run_shards[0];
+
+    if(
+       fseek(shard->stream, 0, SEEK_SET) != 0 ||
+       fwrite(&shard->header, sizeof(shard->header), 1, shard->stream) != 1 ||
+       fclose(shard->stream) != 0
+      )
+        Abort("Failed to write shard file");
+
+    free(run_shards);
+}
+
+static inline char*
+LoadShards (struct arena* arena, int file_count, char** paths)
+{
+    struct shard_file_header first_header;
+    char*                    first_query;
+
+    run_shard_count = (unsigned int)file_count;
+    run_shards      = calloc(file_count, sizeof(struct shard_file));
+    if(run_shards == NULL)
+        Abort("Failed to alloc memory for shard files");
+
+    memset(&first_header, 0, sizeof(first_header));
+
+    first_query = NULL;
+
+    for(int index = 0; index < file_count; index++)
+    {
+        struct shard_file_header header;
+        FILE*                    stream;
+        char*                    query;
+
+        stream = fopen(paths[index], "rb");
+        if(stream == NULL)
+            Abort("Failed to open shard file");
+
+        if(fread(&header, sizeof(header), 1, stream) != 1 || memcmp(header.magic, SHARD_MAGIC, sizeof(header.magic)) != 0)
+            Abort("Not a WarPlan shard file");
+
+        if(header.version != SHARD_VERSION)
+            Abort("Shard file version is not supported");
+
+        query = ArenaAlloc(arena, header.query_size+1);
+        if(fread(query, 1, header.query_size, stream) != header.query_size)
+            Abort("Shard file is truncated");
+
+        query[header.query_size] = '\0';
+
+        if(first_query == NULL)
+        {
+            first_header = header;
+            first_query  = query;
+        }
+
+        /* Every shard must have run the same query the same way, and each slice exactly once */
+        if(
+           header.shard_count != run_shard_count ||
+           header.shard_index >= run_shard_count ||
+           run_shards[header.shard_index].stream != NULL
+          )
+            Abort("Shard files do not make up exactly one of every shard of the run");
+
+        if(
+           header.seed != first_header.seed ||
+           header.flags != first_header.flags ||
+           header.top_plans != first_header.top_plans ||
+           header.cell_count != first_header.cell_count ||
+           memcmp(&header.rules, &first_header.rules, sizeof(header.rules)) != 0 ||
+           strcmp(query, first_query) != 0
+          )
+            Abort("Shard files come from different runs");
+
+        run_shards[header.shard_index].header = header;
+        run_shards[header.shard_index].stream = stream;
+    }
+
+    if((first_header.flags^run_flags)&enable_battle_table)
+        Abort("Merge with --table exactly when the shards were run with it");
+
+    if(memcmp(&first_header.rules, &run_rules, sizeof(run_rules)) != 0)
+        Abort("Merge with the same --rules the shards were run with");
+
+    /* Only the options that shape predictions and plans after sampling matter to a merge */
+    run_seed       = first_header.seed;
+    run_top_plans  = first_header.top_plans;
+    run_flags     |= first_header.flags&(enable_control|enable_exhaustive);
+
+    return first_query;
+}
+
+static inline void
+CloseShards (void)
+{
+    for(unsigned int index = 0; index < run_shard_count; index++)
+    {
+        if(fgetc(run_shards[index].stream) != EOF)
+            Abort("Shard file holds more tallies than the run predicted");
+
+        fclose(run_shards[index].stream);
+    }
+
+    free(run_shards);
+}
+
+static inline void
+WriteShardTallies (struct prediction_tally* tallies, size_t count)
+{
+    if(fwrite(tallies, sizeof(struct prediction_tally), count, run_shards[0].stream) != count)
+        Abort("Failed to write shard file");
+
+    run_shards[0].header.cell_count += count;
+}
+
+static inline void
+ReadShardTallies (struct prediction_tally* tallies, size_t count)
+{
+    for(unsigned int shard = 0; shard < run_shard_count; shard++)
+    {
+        for(size_t index = 0; index < count; index++)
+        {
+            struct prediction_tally shard_tally;
+
+            if(fread(&shard_tally, sizeof(shard_tally), 1, run_shards[shard].stream) != 1)
+                Abort("Shard file ended early, it does not match this run");
+
+            MergeTally(&tallies[index], &shard_tally);
+        }
+    }
+}
+
+static inline uint64_t
+PredictAttacks (
+                struct prediction_cell* cells,
+                size_t                  cell_count,
+                uint64_t                sim_iterations,
+                float                   likelihood_threshold
+               )
+{
+    struct prediction_job    job;
+    struct prediction_tally* cell_tallies;
+    size_t*                  chunks_done;
+    size_t*                  round_ends;
+    size_t                   chunk_count;
+    size_t                   task_capacity;
+    uint64_t                 total_trials;
+    int                      adaptive;
+
+    /*
+     Every cell runs its chunks in rounds.  A fixed run schedules all chunks in a single round,
+     while an adaptive run doubles each cell's chunks every round until the cell is precise
+     enough or has used all of its iterations.  Chunks keep their stream either way, so an
+     adaptive run samples exactly the first chunks of the equivalent fixed run.
+
+     Rounds are run in passes of at most PREDICTION_PASS_TASKS chunks, each merged into its cell's
+     tally before the next pass, so memory stays flat however many trials a cell asks for.  A
+     cell's precision is only checked once its whole round is in.
+     */
+
+    adaptive = run_precision > 0 && !(run_flags&enable_exact_engine);
+
+    if(run_flags&enable_exact_engine)
+        chunk_count = 1;
+    else
+    {
+        chunk_count = sim_iterations/PREDICTION_CHUNK_ITERATIONS+(sim_iterations%PREDICTION_CHUNK_ITERATIONS != 0);
+        chunk_count = MAX(chunk_count, 1);
+    }
+
+    task_capacity = MAX(MIN(cell_count*chunk_count, PREDICTION_PASS_TASKS), 1);
+
+    job.cells          = cells;
+    job.sim_iterations = sim_iterations;
+    job.tasks          = malloc(task_capacity*sizeof(struct prediction_task));
+    job.tallies        = malloc(task_capacity*sizeof(struct prediction_tally));
+    cell_tallies       = calloc(cell_count, sizeof(struct prediction_tally));
+    chunks_done        = calloc(cell_count, sizeof(size_t));
+    round_ends         = calloc(cell_count, sizeof(size_t));
+    if(job.tasks == NULL || job.tallies == NULL || cell_tallies == NULL || chunks_done == NULL || round_ends == NULL)
+        Abort("Failed to alloc memory for prediction tallies");
+
+    CountAllocation(
+                    task_capacity*(sizeof(struct prediction_task)+sizeof(struct prediction_tally))+
+                    cell_count*(sizeof(struct prediction_tally)+2*sizeof(size_t))
+                   );
+
+    /* Cells the battle table covers are composed from it instead, in a single last chunk */
+    for(size_t cell_index = 0; cell_index < cell_count; cell_index++)
+    {
+        cells[cell_index].from_table = !(run_flags&enable_exact_engine) &&
+                                       TableCoversVector(cells[cell_index].attack_vector, cells[cell_index].bonus_units);
+
+        if(cells[cell_index].from_table)
+            chunks_done[cell_index] = chunk_count-1;
+        else if(run_flags&enable_merge)
+            chunks_done[cell_index] = chunk_count;
+
+        round_ends[cell_index] = chunks_done[cell_index];
+    }
+
+    for(;;)
+    {
+        size_t task_count;
+
+        task_count = 0;
+
+        for(size_t cell_index = 0; cell_index < cell_count && task_count < task_capacity; cell_index++)
+        {
+            size_t first_chunk;
+
+            if(chunks_done[cell_index] == chunk_count)
+                continue;
+
+            if(chunks_done[cell_index] == round_ends[cell_index])
+            {
+                if(adaptive)
+                    round_ends[cell_index] += MIN(MAX(chunks_done[cell_index], 1), chunk_count-chunks_done[cell_index]);
+                else
+                    round_ends[cell_index] = chunk_count;
+            }
+
+            first_chunk = chunks_done[cell_index];
+
+            for(
+                size_t chunk_index = first_chunk;
+                chunk_index < round_ends[cell_index] && task_count < task_capacity;
+                chunk_index++
+               )
+            {
+                /* A shard runs every shard_count-th chunk and counts the others done */
+                if(
+                   run_flags&enable_shard &&
+                   !cells[cell_index].from_table &&
+                   chunk_index%run_shard_count != run_shard_index
+                  )
+                {
+                    chunks_done[cell_index]++;
+
+                    continue;
+                }
+
+                job.tasks[task_count].cell_index  = cell_index;
+                job.tasks[task_count].chunk_index = chunk_index;
+
+                task_count++;
+            }
+        }
+
+        if(task_count == 0)
+            break;
+
+        memset(job.tallies, 0, task_count*sizeof(struct prediction_tally));
+
+        RunTasks(&run_pool, task_count, &RunPredictionTask, &job);
+
+        for(size_t task_index = 0; task_index < task_count; task_index++)
+        {
+            size_t cell_index;
+
+            cell_index = job.tasks[task_index].cell_index;
+
+            MergeTally(&cell_tallies[cell_index], &job.tallies[task_index]);
+            chunks_done[cell_index]++;
+        }
+
+        if(adaptive)
+        {
+            for(size_t cell_index = 0; cell_index < cell_count; cell_index++)
+            {
+                if(
+                   chunks_done[cell_index] == round_ends[cell_index] &&
+                   PredictionIsPrecise(&cell_tallies[cell_index], likelihood_threshold)
+                  )
+                    chunks_done[cell_index] = chunk_count;
+            }
+        }
+    }
+
+    if(run_flags&enable_shard)
+        WriteShardTallies(cell_tallies, cell_count);
+    else if(run_flags&enable_merge)
+        ReadShardTallies(cell_tallies, cell_count);
+
+    total_trials = 0;
+
+    if(run_flags&enable_exact_engine)
+        run_stats.exact_predictions += cell_count;
+    else
+    {
+        for(size_t cell_index = 0; cell_index < cell_count; cell_index++)
+        {
+            struct prediction_tally* tally;
+
+            if(cells[cell_index].from_table)
+            {
+                run_stats.exact_predictions++;
+
+                continue;
+            }
+
+            tally = &cell_tallies[cell_index];
+
+            FinishPrediction(tally, cells[cell_index].prediction);
+
+            total_trials += tally->win_count+tally->loss_count;
+        }
+    }
+
+    run_stats.trials += total_trials;
+
+    free(round_ends);
+    free(chunks_done);
+    free(cell_tallies);
+    free(job.tallies);
+    free(job.tasks);
+
+    return total_trials;
+}
+
+static inline void
+SimWar (
+        struct attack_vector_def* attack_vectors,
+        size_t                    count,
+        unsigned int              bonus_units,
+        uint64_t                  sim_iterations,
+        FILE*                     result_stream
+       )
+{
+    struct prediction_cell   cells[count];
+    struct attack_prediction predictions[count];
+    uint64_t                 total_trials;
+
+    for(size_t index = 0; index < count; index++)
+    {
+        cells[index].attack_vector = &attack_vectors[index];
+        cells[index].bonus_units   = bonus_units;
+        cells[index].prediction    = &predictions[index];
+    }
+
+    EnterPhase(phase_predict);
+
+    total_trials = PredictAttacks(cells, count, sim_iterations, NO_LIKELIHOOD_THRESHOLD);
+
+    EnterPhase(phase_report);
+
+    if(result_stream != NULL)
+    {
+        fprintf(result_stream, "ok trials=%llu", (unsigned long long)total_trials);
+        for(size_t index = 0; index < count; index++)
+            WritePrediction(result_stream, &attack_vectors[index], bonus_units, &predictions[index]);
+        fprintf(result_stream, "\n");
+
+        return;
+    }
+
+    for(size_t index = 0; index < count; index++)
+    {
+        printf("\n");
+        PrintPrediction(attack_vectors[index].def_string, &predictions[index]);
+    }
+}
+
+static inline void
+InitCombinations (unsigned int* indices, size_t index_count)
+{
+    for(size_t index = index_count; index-- > 0;)
+        indices[index] = 0;
+}
+
+static inline enum combinations_state
+NextCombination (unsigned int* indices, size_t index_count, unsigned int last_index)
+{
+    size_t index;
+
+    index = 0;
+
+    do
+    {
+        indices[index]++;
+        if(indices[index] <= last_index)
+            return combinations_remain;
+
+        indices[index] = 0;
+
+        index++;
+    }while(index < index_count);
+
+    return combinations_exhausted;
+}
+
+static inline void
+InitPlanHeap (struct plan_heap* heap, size_t capacity, size_t attack_vector_count)
+{
+    heap->plans      = malloc(capacity*sizeof(struct attack_plan));
+    heap->bonus_pool = malloc(capacity*attack_vector_count*sizeof(uint16_t));
+    if(heap->plans == NULL || heap->bonus_pool == NULL)
+        Abort("Memory alloc for plans failed");
+
+    CountAllocation(capacity*(sizeof(struct attack_plan)+attack_vector_count*sizeof(uint16_t)));
+
+    heap->plan_count          = 0;
+    heap->capacity            = capacity;
+    heap->attack_vector_count = attack_vector_count;
+}
+
+static inline void
+FreePlanHeap (struct plan_heap* heap)
+{
+    free(heap->bonus_pool);
+    free(heap->plans);
+}
+
+static inline void
+SwapPlans (struct attack_plan* left, struct attack_plan* right)
+{
+    struct attack_plan swap;
+
+    swap   = *left;
+    *left  = *right;
+    *right = swap;
+}
+
+static inline void
+OfferPlan (struct plan_heap* heap, float total_score, unsigned int* bonuses)
+{
+    struct attack_plan* plans;
+    size_t              index;
+
+    /*
+     The heap keeps the lowest scoring plan at its root, so a new plan either fills a free slot
+     and sifts up, or replaces the root when it beats it and sifts down.  Plans only ever swap
+     their bonus pool pointers, the packed bonuses themselves stay put.
+     */
+
+    plans = heap->plans;
+
+    if(heap->plan_count < heap->capacity)
+    {
+        index = heap->plan_count++;
+
+        plans[index].bonuses = &heap->bonus_pool[index*heap->attack_vector_count];
+    }
+    else if(plans[0].total_score < total_score)
+        index = 0;
+    else
+        return;
+
+    run_stats.plans_kept++;
+
+    plans[index].total_score = total_score;
+    for(size_t vector_index = 0; vector_index < heap->attack_vector_count; vector_index++)
+        plans[index].bonuses[vector_index] = (uint16_t)bonuses[vector_index];
+
+    while(index > 0 && plans[(index-1)/2].total_score > plans[index].total_score)
+    {
+        SwapPlans(&plans[index], &plans[(index-1)/2]);
+
+        index = (index-1)/2;
+    }
+
+    for(;;)
+    {
+        size_t lowest;
+        size_t child;
+
+        lowest = index;
+
+        child = 2*index+1;
+        if(child < heap->plan_count && plans[child].total_score < plans[lowest].total_score)
+            lowest = child;
+
+        child++;
+        if(child < heap->plan_count && plans[child].total_score < plans[lowest].total_score)
+            lowest = child;
+
+        if(lowest == index)
+            break;
+
+        SwapPlans(&plans[index], &plans[lowest]);
+
+        index = lowest;
+    }
+}
+
+static inline void
+PlanExhaustive (
+                struct attack_setup* setups,
+                size_t               attack_vector_count,
+                unsigned int         bonus_units,
+                struct plan_heap*    heap
+               )
+{
+    unsigned int bonus_indices[attack_vector_count];
+
+    InitCombinations(bonus_indices, attack_vector_count);
+
+    do
+    {
+        unsigned int total_bonus;
+        float        total_score;
+
+        total_bonus = 0;
+        total_score = 0;
+
+        for(size_t index = attack_vector_count; index-- > 0;)
+        {
+            unsigned int bonus;
+
+            bonus = bonus_indices[index];
+
+            total_bonus += bonus;
+            total_score += setups[index*(bonus_units+1)+bonus].score;
+        }
+
+        if(total_bonus != bonus_units)
+            continue;
+
+        run_stats.plan_candidates++;
+
+        OfferPlan(heap, total_score, bonus_indices);
+    }while(NextCombination(bonus_indices, attack_vector_count, bonus_units) == combinations_remain);
+}
+
+static inline void
+InsertAllocation (
+                  struct allocation_entry* entries,
+                  unsigned int*            entry_count,
+                  size_t                   top_count,
+                  float                    total_score,
+                  unsigned int             bonus,
+                  unsigned int             parent_rank
+                 )
+{
+    size_t index;
+
+    run_stats.plan_candidates++;
+
+    /* Entries stay sorted best first, a candidate no better than a full list's last is dropped */
+    if(*entry_count == top_count && entries[top_count-1].total_score >= total_score)
+        return;
+
+    if(*entry_count < top_count)
+        (*entry_count)++;
+
+    for(index = *entry_count-1; index > 0 && entries[index-1].total_score < total_score; index--)
+        entries[index] = entries[index-1];
+
+    entries[index].total_score = total_score;
+    entries[index].bonus       = bonus;
+    entries[index].parent_rank = parent_rank;
+}
+
+static inline void
+PlanAllocation (
+                struct attack_setup* setups,
+                size_t               attack_vector_count,
+                unsigned int         bonus_units,
+                struct plan_heap*    heap
+               )
+{
+    struct allocation_entry* entries;
+    unsigned int*            entry_counts;
+    unsigned int             bonuses[attack_vector_count];
+    size_t                   row_size;
+    size_t                   top_count;
+    size_t                   plan_count;
+
+    /*
+     Plan scores are sums of independent setup scores, so the best plans spending exactly
+     `spent` units on vectors 0..index extend the best plans for vectors 0..index-1.  Every
+     (index, spent) cell keeps its top_count best partial plans, each remembering the bonus given
+     to vector index and the rank of the partial plan it extends, which is enough to rebuild the
+     final plans backwards.
+     */
+
+    row_size     = bonus_units+1;
+    top_count    = heap->capacity;
+    entries      = malloc(attack_vector_count*row_size*top_count*sizeof(struct allocation_entry));
+    entry_counts = calloc(attack_vector_count*row_size, sizeof(unsigned int));
+    if(entries == NULL || entry_counts == NULL)
+        Abort("Failed to alloc memory for bonus allocation");
+
+    CountAllocation(attack_vector_count*row_size*(top_count*sizeof(struct allocation_entry)+sizeof(unsigned int)));
+
+    for(unsigned int spent = 0; spent <= bonus_units; spent++)
+        InsertAllocation(&entries[spent*top_count], &entry_counts[spent], top_count, setups[spent].score, spent, 0);
+
+    for(size_t index = 1; index < attack_vector_count; index++)
+    {
+        struct attack_setup* vector_setups;
+
+        vector_setups = &setups[index*row_size];
+
+        for(unsigned int spent = 0; spent <= bonus_units; spent++)
+        {
+            struct allocation_entry* cell_entries;
+            unsigned int*            cell_count;
+
+            cell_entries = &entries[(index*row_size+spent)*top_count];
+            cell_count   = &entry_counts[index*row_size+spent];
+
+            for(unsigned int bonus = 0; bonus <= spent; bonus++)
+            {
+                struct allocation_entry* parent_entries;
+                unsigned int             parent_count;
+                size_t                   parent_cell;
+
+                parent_cell    = (index-1)*row_size+spent-bonus;
+                parent_entries = &entries[parent_cell*top_count];
+                parent_count   = entry_counts[parent_cell];
+
+                for(unsigned int rank = 0; rank < parent_count; rank++)
+                {
+                    InsertAllocation(
+                                     cell_entries,
+                                     cell_count,
+                                     top_count,
+                                     parent_entries[rank].total_score+vector_setups[bonus].score,
+                                     bonus,
+                                     rank
+                                    );
+                }
+            }
+        }
+    }
+
+    plan_count = entry_counts[(attack_vector_count-1)*row_size+bonus_units];
+
+    for(size_t plan_index = 0; plan_index < plan_count; plan_index++)
+    {
+        unsigned int spent;
+        unsigned int rank;
+
+        spent = bonus_units;
+        rank  = plan_index;
+
+        for(size_t index = attack_vector_count; index-- > 0;)
+        {
+            struct allocation_entry* entry;
+
+            entry = &entries[(index*row_size+spent)*top_count+rank];
+
+            bonuses[index] = entry->bonus;
+
+            spent -= entry->bonus;
+            rank   = entry->parent_rank;
+        }
+
+        OfferPlan(
+                  heap,
+                  entries[((attack_vector_count-1)*row_size+bonus_units)*top_count+plan_index].total_score,
+                  bonuses
+                 );
+    }
+
+    free(entry_counts);
+    free(entries);
+}
+
+static inline void
+ScoreSetup (struct attack_setup* setup, float likelihood_threshold)
+{
+    float win_likelihood;
+
+    win_likelihood = setup->prediction.win_likelihood;
+
+    if(win_likelihood >= likelihood_threshold)
+        setup->score = win_likelihood;
+    else
+        setup->score = 0;
+}
+
+static inline uint64_t
+EvaluateSetups (
+                struct attack_setup** setups,
+                size_t                count,
+                uint64_t              sim_iterations,
+                float                 likelihood_threshold,
+                size_t*               evaluated_count
+               )
+{
+    struct prediction_cell* cells;
+    size_t                  cell_count;
+    uint64_t                total_trials;
+
+    cells = malloc(MAX(count, 1)*sizeof(struct prediction_cell));
+    if(cells == NULL)
+        Abort("Failed to alloc memory for prediction cells");
+
+    CountAllocation(MAX(count, 1)*sizeof(struct prediction_cell));
+
+    cell_count = 0;
+
+    for(size_t index = 0; index < count; index++)
+    {
+        struct attack_setup* setup;
+
+        setup = setups[index];
+        if(setup->evaluated)
+            continue;
+
+        /* The same setup may be listed twice, marking it now keeps it to a single cell */
+        setup->evaluated = 1;
+
+        cells[cell_count].attack_vector = setup->attack_vector;
+        cells[cell_count].bonus_units   = setup->bonus;
+        cells[cell_count].prediction    = &setup->prediction;
+
+        cell_count++;
+    }
+
+    total_trials = PredictAttacks(cells, cell_count, sim_iterations, likelihood_threshold);
+
+    for(size_t index = 0; index < count; index++)
+        ScoreSetup(setups[index], likelihood_threshold);
+
+    *evaluated_count += cell_count;
+
+    free(cells);
+
+    return total_trials;
+}
+
+static inline uint64_t
+SearchBonusLevels (
+                   struct attack_setup* setups,
+                   size_t               attack_vector_count,
+                   unsigned int         bonus_units,
+                   uint64_t             sim_iterations,
+                   float                likelihood_threshold,
+                   float                target_likelihood,
+                   unsigned int*        first_levels,
+                   size_t*              evaluated_count
+                  )
+{
+    struct bonus_search  searches[attack_vector_count];
+    struct attack_setup* probes[attack_vector_count];
+    uint64_t             total_trials;
+    size_t               searching_count;
+
+    /*
+     On entry first_levels holds the level each vector's search starts from, on return the
+     first level whose win likelihood reaches target_likelihood, or bonus_units+1 if none does.
+     Every vector gallops upwards from its start, probing 1, 2, 4, ... levels further each time,
+     until a probe reaches the target and then bisects the last gap.  All vectors probe in
+     lockstep so each round's predictions run together.
+     */
+
+    total_trials    = 0;
+    searching_count = 0;
+
+    for(size_t index = 0; index < attack_vector_count; index++)
+    {
+        struct bonus_search* search;
+
+        search = &searches[index];
+
+        search->searching = first_levels[index] <= bonus_units;
+        if(!search->searching)
+            continue;
+
+        search->known_false = first_levels[index];
+        search->known_true  = bonus_units+1;
+        search->gallop_step = 1;
+        search->probe       = first_levels[index];
+
+        searching_count++;
+    }
+
+    while(searching_count > 0)
+    {
+        size_t probe_count;
+
+        probe_count = 0;
+
+        for(size_t index = 0; index < attack_vector_count; index++)
+        {
+            if(searches[index].searching)
+                probes[probe_count++] = &setups[index*(bonus_units+1)+searches[index].probe];
+        }
+
+        total_trials += EvaluateSetups(
+                                       probes,
+                                       probe_count,
+                                       sim_iterations,
+                                       likelihood_threshold,
+                                       evaluated_count
+                                      );
+
+        for(size_t index = 0; index < attack_vector_count; index++)
+        {
+            struct bonus_search* search;
+            unsigned int         probe;
+            int                  galloping;
+
+            search = &searches[index];
+            if(!search->searching)
+                continue;
+
+            probe     = search->probe;
+            galloping = search->known_true > bonus_units;
+
+            if(setups[index*(bonus_units+1)+probe].prediction.win_likelihood >= target_likelihood)
+                search->known_true = probe;
+            else
+                search->known_false = probe;
+
+            /* The starting level itself may already reach the target */
+            if(search->known_true == first_levels[index])
+            {
+                search->searching = 0;
+                searching_count--;
+
+                continue;
+            }
+
+            if(galloping && search->known_true > bonus_units)
+            {
+                if(probe == bonus_units)
+                {
+                    first_levels[index] = bonus_units+1;
+                    search->searching   = 0;
+                    searching_count--;
+
+                    continue;
+                }
+
+                search->probe        = MIN(probe+search->gallop_step, bonus_units);
+                search->gallop_step *= 2;
+
+                continue;
+            }
+
+            if(search->known_true-search->known_false <= 1)
+            {
+                first_levels[index] = search->known_true;
+                search->searching   = 0;
+                searching_count--;
+
+                continue;
+            }
+
+            search->probe = search->known_false+(search->known_true-search->known_false)/2;
+        }
+    }
+
+    return total_trials;
+}
+
+static inline void
+InitSetupRow (struct attack_setup* row, struct attack_vector_def* attack_vector, unsigned int bonus_units)
+{
+    for(unsigned int bonus = 0; bonus <= bonus_units; bonus++)
+    {
+        row[bonus].attack_vector = attack_vector;
+        row[bonus].bonus         = bonus;
+        row[bonus].score         = 0;
+        row[bonus].evaluated     = 0;
+    }
+}
+
+static inline uint64_t
+PredictSetups (
+               struct attack_setup*  setups,
+               size_t                attack_vector_count,
+               unsigned int          bonus_units,
+               float                 likelihood_threshold,
+               uint64_t              sim_iterations,
+               struct attack_setup** pending_setups,
+               size_t*               evaluated_count
+              )
+{
+    size_t   row_size;
+    size_t   pending_count;
+    uint64_t total_trials;
+
+    /* Rows are independent of each other, so any run of them can be predicted on its own */
+    row_size      = bonus_units+1;
+    pending_count = 0;
+    total_trials  = 0;
+
+    if(run_flags&enable_curve)
+    {
+        struct curve_job job;
+
+        job.setups      = setups;
+        job.bonus_units = bonus_units;
+
+        RunTasks(&run_pool, attack_vector_count, &RunCurveTask, &job);
+
+        for(size_t index = 0; index < attack_vector_count*row_size; index++)
+        {
+            setups[index].evaluated = 1;
+            ScoreSetup(&setups[index], likelihood_threshold);
+        }
+
+        run_stats.curve_sweeps      += attack_vector_count;
+        run_stats.exact_predictions += attack_vector_count*row_size;
+        *evaluated_count            += attack_vector_count*row_size;
+
+        return 0;
+    }
+
+    for(size_t index = 0; index < attack_vector_count*row_size; index++)
+        pending_setups[pending_count++] = &setups[index];
+
+    if(run_flags&enable_monotone)
+    {
+        unsigned int threshold_levels[attack_vector_count];
+        unsigned int certain_levels[attack_vector_count];
+
+        for(size_t index = 0; index < attack_vector_count; index++)
+            threshold_levels[index] = 0;
+
+        total_trials += SearchBonusLevels(
+                                          setups,
+                                          attack_vector_count,
+                                          bonus_units,
+                                          sim_iterations,
+                                          likelihood_threshold,
+                                          likelihood_threshold,
+                                          threshold_levels,
+                                          evaluated_count
+                                         );
+
+        memcpy(certain_levels, threshold_levels, sizeof(certain_levels));
+
+        total_trials += SearchBonusLevels(
+                                          setups,
+                                          attack_vector_count,
+                                          bonus_units,
+                                          sim_iterations,
+                                          likelihood_threshold,
+                                          (float)(1-run_precision),
+                                          certain_levels,
+                                          evaluated_count
+                                         );
+
+        pending_count = 0;
+
+        for(size_t index = 0; index < attack_vector_count; index++)
+        {
+            for(unsigned int bonus = 0; bonus <= bonus_units; bonus++)
+            {
+                struct attack_setup* setup;
+
+                setup = &setups[index*row_size+bonus];
+
+                if(bonus < threshold_levels[index])
+                    setup->score = 0;
+                else if(bonus > certain_levels[index])
+                    setup->score = setups[index*row_size+certain_levels[index]].score;
+                else
+                    pending_setups[pending_count++] = setup;
+            }
+        }
+    }
+
+    total_trials += EvaluateSetups(
+                                   pending_setups,
+                                   pending_count,
+                                   sim_iterations,
+                                   likelihood_threshold,
+                                   evaluated_count
+                                  );
+
+    return total_trials;
+}
+
+static inline void
+ReportPlans (
+             struct attack_setup*  setups,
+             size_t                attack_vector_count,
+             unsigned int          bonus_units,
+             float                 likelihood_threshold,
+             uint64_t              sim_iterations,
+             struct attack_setup** pending_setups,
+             uint64_t              total_trials,
+             size_t                evaluated_count,
+             FILE*                 result_stream
+            )
+{
+    struct plan_heap    heap;
+    struct attack_plan* plans;
+    size_t              row_size;
+    size_t              pending_count;
+    size_t              plan_count;
+
+    row_size = bonus_units+1;
+
+    EnterPhase(phase_plan);
+
+    InitPlanHeap(&heap, run_top_plans, attack_vector_count);
+
+    if(run_flags&enable_exhaustive)
+        PlanExhaustive(setups, attack_vector_count, bonus_units, &heap);
+    else
+        PlanAllocation(setups, attack_vector_count, bonus_units, &heap);
+
+    plans      = heap.plans;
+    plan_count = heap.plan_count;
+
+    EnterPhase(phase_sort);
+
+    qsort(plans, plan_count, sizeof(struct attack_plan), &ComparePlan);
+
+    EnterPhase(phase_report);
+
+    if(run_flags&enable_monotone)
+    {
+        EnterPhase(phase_predict);
+
+        pending_count = 0;
+
+        for(size_t plan_index = 0; plan_index < plan_count; plan_index++)
+        {
+            for(size_t index = 0; index < attack_vector_count; index++)
+                pending_setups[pending_count++] = &setups[index*row_size+plans[plan_index].bonuses[index]];
+        }
+
+        total_trials += EvaluateSetups(
+                                       pending_setups,
+                                       pending_count,
+                                       sim_iterations,
+                                       likelihood_threshold,
+                                       &evaluated_count
+                                      );
+
+        EnterPhase(phase_report);
+
+        if(result_stream == NULL)
+        {
+            printf(
+                   "Monotone search predicted %zu of %zu setups\n\n",
+                   evaluated_count,
+                   attack_vector_count*row_size
+                  );
+        }
+    }
+
+    if(result_stream != NULL)
+    {
+        fprintf(result_stream, "ok trials=%llu", (unsigned long long)total_trials);
+
+        for(size_t plan_index = 0; plan_index < plan_count; plan_index++)
+        {
+            fprintf(result_stream, " plan=%zu score=%.6f", plan_index+1, plans[plan_index].total_score);
+
+            for(size_t index = 0; index < attack_vector_count; index++)
+            {
+                struct attack_setup* setup;
+
+                setup = &setups[index*row_size+plans[plan_index].bonuses[index]];
+                WritePrediction(result_stream, setup->attack_vector, setup->bonus, &setup->prediction);
+            }
+        }
+
+        fprintf(result_stream, "\n");
+    }
+    else if(run_precision > 0 && !(run_flags&enable_exact_engine))
+    {
+        printf(
+               "Adaptive sampling used %llu of up to %llu trials\n\n",
+               (unsigned long long)total_trials,
+               (unsigned long long)evaluated_count*sim_iterations
+              );
+    }
+
+    if(result_stream == NULL && plan_count == 1)
+        printf("Highest scoring setup is below\n");
+
+    for(size_t plan_index = 0; result_stream == NULL && plan_index < plan_count; plan_index++)
+    {
+        if(plan_count > 1)
+        {
+            printf(
+                   "%sPlan %zu of %zu, total score %.2f\n",
+                   plan_index > 0 ? "\n" : "",
+                   plan_index+1,
+                   plan_count,
+                   plans[plan_index].total_score
+                  );
+        }
+
+        for(size_t index = 0; index < attack_vector_count; index++)
+            PrintSetup(&setups[index*row_size+plans[plan_index].bonuses[index]]);
+    }
+
+    FreePlanHeap(&heap);
+}
+
+static inline void
+PlanWar (
+         struct attack_vector_def* attack_vectors,
+         size_t                    attack_vector_count,
+         unsigned int              bonus_units,
+         float                     likelihood_threshold,
+         uint64_t                  sim_iterations,
+         FILE*                     result_stream
+        )
+{
+    struct attack_setup*  setups;
+    struct attack_setup** pending_setups;
+    size_t                row_size;
+    size_t                setup_count;
+    size_t                evaluated_count;
+    uint64_t              total_trials;
+
+    row_size       = bonus_units+1;
+    setup_count    = attack_vector_count*row_size;
+    setups         = malloc(setup_count*sizeof(struct attack_setup));
+    pending_setups = malloc(setup_count*sizeof(struct attack_setup*));
+    if(setups == NULL || pending_setups == NULL)
+        Abort("Failed to alloc memory for setups");
+
+    CountAllocation(setup_count*(sizeof(struct attack_setup)+sizeof(struct attack_setup*)));
+
+    for(size_t index = 0; index < attack_vector_count; index++)
+        InitSetupRow(&setups[index*row_size], &attack_vectors[index], bonus_units);
+
+    evaluated_count = 0;
+
+    EnterPhase(phase_predict);
+
+    total_trials = PredictSetups(
+                                 setups,
+                                 attack_vector_count,
+                                 bonus_units,
+                                 likelihood_threshold,
+                                 sim_iterations,
+                                 pending_setups,
+                                 &evaluated_count
+                                );
+
+    if(run_flags&enable_curve && result_stream == NULL)
+    {
+        EnterPhase(phase_report);
+
+        for(size_t index = 0; index < attack_vector_count; index++)
+            PrintCurve(&setups[index*row_size], bonus_units);
+    }
+
+    ReportPlans(
+                setups,
+                attack_vector_count,
+                bonus_units,
+                likelihood_threshold,
+                sim_iterations,
+                pending_setups,
+                total_trials,
+                evaluated_count,
+                result_stream
+               );
+
+    free(pending_setups);
+    free(setups);
+}
+
+static inline void
+RunWar (struct war_query* query, FILE* result_stream)
+{
+    if(query->bonus_units == 0)
+    {
+        if(result_stream == NULL)
+            printf("Simulating simple war and printing predictions\n\n");
+
+        SimWar(
+               query->attack_vectors,
+               query->attack_vector_count,
+               query->bonus_units,
+               query->sim_iterations,
+               result_stream
+              );
+    }
+    else
+    {
+        if(result_stream == NULL)
+            printf("Attempting to plan war for specified vectors\n\n");
+
+        PlanWar(
+                query->attack_vectors,
+                query->attack_vector_count,
+                query->bonus_units,
+                query->likelihood_threshold,
+                query->sim_iterations,
+                result_stream
+               );
+    }
+
+    LeavePhase();
+}
+
+static inline void
+InitLineReader (struct line_reader* reader, int fd)
+{
+    reader->buffer = malloc(SERVE_LINE_SIZE);
+    if(reader->buffer == NULL)
+        Abort("Failed to alloc memory for line reader");
+
+    reader->fd       = fd;
+    reader->capacity = SERVE_LINE_SIZE;
+    reader->start    = 0;
+    reader->end      = 0;
+}
+
+static inline char*
+ReadLine (struct line_reader* reader, FILE* result_stream)
+{
+    for(;;)
+    {
+        char*   line;
+        char*   newline;
+        ssize_t read_size;
+
+        line    = &reader->buffer[reader->start];
+        newline = memchr(line, '\n', reader->end-reader->start);
+        if(newline != NULL)
+        {
+            *newline       = '\0';
+            reader->start += (size_t)(newline-line)+1;
+
+            return line;
+        }
+
+        if(reader->start > 0)
+        {
+            memmove(reader->buffer, line, reader->end-reader->start);
+
+            reader->end   -= reader->start;
+            reader->start  = 0;
+        }
+
+        if(reader->end+1 >= reader->capacity)
+        {
+            reader->capacity *= 2;
+            reader->buffer    = realloc(reader->buffer, reader->capacity);
+            if(reader->buffer == NULL)
+                Abort("Failed to alloc memory for line reader");
+        }
+
+        /* Only hand results back once every query already sent has been answered */
+        fflush(result_stream);
+
+        read_size = read(reader->fd, &reader->buffer[reader->end], reader->capacity-reader->end-1);
+        if(read_size < 0 && errno == EINTR)
+            continue;
+
+        if(read_size <= 0)
+        {
+            if(reader->end == 0)
+                return NULL;
+
+            reader->buffer[reader->end] = '\0';
+            reader->start               = reader->end;
+
+            return reader->buffer;
+        }
+
+        reader->end += (size_t)read_size;
+    }
+}
+
+static inline int
+ServeQueries (int fd, FILE* result_stream)
+{
+    struct line_reader reader;
+    struct war_query   query;
+    char*              line;
+    int                quit;
+
+    InitLineReader(&reader, fd);
+
+    quit = 0;
+
+    while((line = ReadLine(&reader, result_stream)) != NULL)
+    {
+        char** args;
+        char*  error;
+        int    arg_count;
+
+        ResetArena(&run_arena);
+
+        args = SplitQueryArgs(&run_arena, line, &arg_count);
+        if(arg_count == 0)
+            continue;
+
+        if(strcmp(args[0], "quit") == 0)
+        {
+            quit = 1;
+
+            break;
+        }
+
+        error = ParseQuery(&run_arena, arg_count, args, &query);
+
+        if(error != NULL)
+        {
+            fprintf(result_stream, "error %s\n", error);
+
+            continue;
+        }
+
+        /* Every query gets fresh random streams, still reproducible for a given --seed */
+        run_seed = MixSeed(run_seed);
+
+        RunWar(&query, result_stream);
+    }
+
+    fflush(result_stream);
+    free(reader.buffer);
+
+    return quit;
+}
+
+static inline void
+Serve (void)
+{
+    struct sockaddr_un address;
+    int                listen_fd;
+
+    if(run_serve_socket == NULL)
+    {
+        ServeQueries(STDIN_FILENO, stdout);
+
+        return;
+    }
+
+    if(strlen(run_serve_socket) >= sizeof(address.sun_path))
+        Abort("Socket path is too long");
+
+    /* A client hanging up early must not take the server down with it */
+    signal(SIGPIPE, SIG_IGN);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0)
+        Abort("Failed to create socket");
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, run_serve_socket);
+
+    unlink(run_serve_socket);
+
+    if(bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+        Abort("Failed to bind socket");
+
+    if(listen(listen_fd, SERVE_SOCKET_QUEUE) != 0)
+        Abort("Failed to listen on socket");
+
+    for(;;)
+    {
+        FILE* result_stream;
+        int   client_fd;
+        int   quit;
+
+        client_fd = accept(listen_fd, NULL, NULL);
+        if(client_fd < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            Abort("Failed to accept connection");
+        }
+
+        result_stream = fdopen(dup(client_fd), "w");
+        if(result_stream == NULL)
+            Abort("Failed to open connection stream");
+
+        quit = ServeQueries(client_fd, result_stream);
+
+        fclose(result_stream);
+        close(client_fd);
+
+        if(quit)
+            break;
+    }
+
+    close(listen_fd);
+    unlink(run_serve_socket);
+}
+
+static inline void
+PlaceSessionRows (struct war_session* session)
+{
+    size_t row_size;
+
+    /* Vectors and rows both move when they grow or shift, so every row is pointed back at its vector */
+    row_size = session->query.bonus_units+1;
+
+    for(size_t index = 0; index < session->query.attack_vector_count; index++)
+    {
+        for(size_t bonus = 0; bonus < row_size; bonus++)
+            session->setups[index*row_size+bonus].attack_vector = &session->query.attack_vectors[index];
+    }
+}
+
+static inline void
+ReserveSessionVectors (struct war_session* session, size_t attack_vector_count)
+{
+    size_t row_size;
+
+    if(attack_vector_count <= session->vector_capacity)
+        return;
+
+    row_size                  = session->query.bonus_units+1;
+    session->vector_capacity  = MAX(attack_vector_count, session->vector_capacity*2);
+
+    session->query.attack_vectors = realloc(
+                                            session->query.attack_vectors,
+                                            session->vector_capacity*sizeof(struct attack_vector_def)
+                                           );
+    session->setups               = realloc(
+                                            session->setups,
+                                            session->vector_capacity*row_size*sizeof(struct attack_setup)
+                                           );
+    session->pending_setups       = realloc(
+                                            session->pending_setups,
+                                            session->vector_capacity*row_size*sizeof(struct attack_setup*)
+                                           );
+    if(session->query.attack_vectors == NULL || session->setups == NULL || session->pending_setups == NULL)
+        Abort("Failed to alloc memory for session");
+
+    CountAllocation(
+                    session->vector_capacity*(
+                                              sizeof(struct attack_vector_def)+
+                                              row_size*(sizeof(struct attack_setup)+sizeof(struct attack_setup*))
+                                             )
+                   );
+
+    PlaceSessionRows(session);
+}
+
+static inline uint64_t
+PredictSessionRows (struct war_session* session, size_t first_row, size_t row_count, size_t* evaluated_count)
+{
+    size_t row_size;
+
+    if(row_count == 0)
+        return 0;
 
-    attack_unit_count = units_on_front-MIN_TERRITORY_UNITS;
-    attack_dice_count = MIN(attack_unit_count, MAX_ATTACK_DICE_COUNT);
+    row_size = session->query.bonus_units+1;
 
-    defend_unit_count = territory_units;
-    defend_dice_count = MIN(defend_unit_count, MAX_DEFEND_DICE_COUNT);
+    for(size_t index = first_row; index < first_row+row_count; index++)
+        InitSetupRow(&session->setups[index*row_size], &session->query.attack_vectors[index], session->query.bonus_units);
 
-    RollDice(attack_dice, attack_dice_count);
-    RollDice(defend_dice, defend_dice_count);
+    return PredictSetups(
+                         &session->setups[first_row*row_size],
+                         row_count,
+                         session->query.bonus_units,
+                         session->query.likelihood_threshold,
+                         session->query.sim_iterations,
+                         session->pending_setups,
+                         evaluated_count
+                        );
+}
 
-    compare_dice_count = MIN(attack_dice_count, defend_dice_count);
-    lost_attack_units  = 0;
-    lost_defend_units  = 0;
+static inline char*
+ParseSessionVector (struct war_session* session, char* def_string, struct attack_vector_def* attack_vector)
+{
+    /* The line is gone by the next command, the vector lives on in the session's arena */
+    return ParseAttackVector(&session->arena, ArenaCopyString(&session->arena, def_string), attack_vector);
+}
 
-    for(unsigned int index = 0; index < compare_dice_count; index++)
+static inline char*
+ParseSessionIndex (struct war_session* session, char* index_string, size_t* index)
+{
+    char*         end;
+    unsigned long number;
+
+    number = strtoul(index_string, &end, 10);
+    if(end == index_string || *end != '\0' || number == 0 || number > session->query.attack_vector_count)
+        return "No attack vector with that number, vectors count from 1";
+
+    *index = number-1;
+
+    return NULL;
+}
+
+static inline char*
+StartSession (struct war_session* session, char* line)
+{
+    struct war_query query;
+    struct arena     arena;
+    char**           args;
+    char*            error;
+    int              arg_count;
+
+    /* A new query is parsed into the spare arena so a malformed one leaves the session as it was */
+    ResetArena(&session->spare_arena);
+
+    args  = SplitQueryArgs(&session->spare_arena, ArenaCopyString(&session->spare_arena, line), &arg_count);
+    error = ParseQuery(&session->spare_arena, arg_count, args, &query);
+    if(error != NULL)
+        return error;
+
+    arena                = session->arena;
+    session->arena       = session->spare_arena;
+    session->spare_arena = arena;
+
+    session->query.sim_iterations       = query.sim_iterations;
+    session->query.likelihood_threshold = query.likelihood_threshold;
+    session->query.attack_vector_count  = 0;
+
+    /* Rows change length with the bonus units, so the old rows are of no further use */
+    if(query.bonus_units != session->query.bonus_units)
     {
-        if(attack_dice[index] > defend_dice[index])
-            lost_defend_units++;
-        else
-            lost_attack_units++;
+        session->query.bonus_units = query.bonus_units;
+        session->vector_capacity   = 0;
     }
 
-    if(run_flags&enable_debugging)
-    {
-        char attack_dice_string[MAX_DICE_STRING_SIZE];
-        char defend_dice_string[MAX_DICE_STRING_SIZE];
+    ReserveSessionVectors(session, query.attack_vector_count);
 
-        DiceToString(attack_dice, attack_dice_count, attack_dice_string);
-        DiceToString(defend_dice, defend_dice_count, defend_dice_string);
+    memcpy(session->query.attack_vectors, query.attack_vectors, query.attack_vector_count*sizeof(struct attack_vector_def));
+    session->query.attack_vector_count = query.attack_vector_count;
 
-        Debug(
-              "%u [%s] vs %u [%s] = %u front units lost and %u defending units lost\n",
-              units_on_front,
-              attack_dice_string,
-              defend_unit_count,
-              defend_dice_string,
-              lost_attack_units,
-              lost_defend_units
-             );
-    }
+    session->active = 1;
 
-    *remaining_units_on_front  = units_on_front-lost_attack_units;
-    *remaining_territory_units = territory_units-lost_defend_units;
+    return NULL;
 }
 
-static inline void
-AttackTerritory (
-                 unsigned int          units_on_front,
-                 struct territory_def* territory,
-                 unsigned int*         remaining_units_on_front,
-                 unsigned int*         remaining_territory_units
-                )
+static inline char*
+EditSession (struct war_session* session, int arg_count, char** args, size_t* first_row, size_t* row_count)
 {
-    unsigned int front_units;
-    unsigned int territory_units;
+    struct attack_vector_def attack_vector;
+    size_t                   row_size;
+    size_t                   index;
+    char*                    error;
 
-    front_units     = units_on_front;
-    territory_units = territory->units;
+    if(!session->active)
+        return "No query to edit yet, send a full query first";
+
+    row_size   = session->query.bonus_units+1;
+    *first_row = 0;
+    *row_count = 0;
+
+    if(strcmp(args[0], "set") == 0 && arg_count == 3)
+    {
+        error = ParseSessionIndex(session, args[1], &index);
+        if(error == NULL)
+            error = ParseSessionVector(session, args[2], &attack_vector);
+        if(error != NULL)
+            return error;
+
+        session->query.attack_vectors[index] = attack_vector;
 
-    while(front_units > MIN_TERRITORY_UNITS && territory_units > 0)
+        *first_row = index;
+        *row_count = 1;
+    }
+    else if(strcmp(args[0], "add") == 0 && arg_count == 2)
     {
-        SingleAttack(
-                     front_units,
-                     territory_units,
-                     &front_units,
-                     &territory_units
-                    );
+        error = ParseSessionVector(session, args[1], &attack_vector);
+        if(error != NULL)
+            return error;
+
+        ReserveSessionVectors(session, session->query.attack_vector_count+1);
+
+        index                                 = session->query.attack_vector_count++;
+        session->query.attack_vectors[index]  = attack_vector;
+
+        *first_row = index;
+        *row_count = 1;
     }
+    else if(strcmp(args[0], "remove") == 0 && arg_count == 2)
+    {
+        error = ParseSessionIndex(session, args[1], &index);
+        if(error != NULL)
+            return error;
 
-    *remaining_units_on_front  = front_units;
-    *remaining_territory_units = territory_units;
+        if(session->query.attack_vector_count == 1)
+            return "A session keeps at least one attack vector";
+
+        session->query.attack_vector_count--;
+
+        memmove(
+                &session->query.attack_vectors[index],
+                &session->query.attack_vectors[index+1],
+                (session->query.attack_vector_count-index)*sizeof(struct attack_vector_def)
+               );
+        memmove(
+                &session->setups[index*row_size],
+                &session->setups[(index+1)*row_size],
+                (session->query.attack_vector_count-index)*row_size*sizeof(struct attack_setup)
+               );
+
+        PlaceSessionRows(session);
+    }
+    else
+        return "Malformed session command, see usage";
+
+    return NULL;
 }
 
 static inline void
-SimAttack (
-           struct attack_vector_def* attack_vector,
-           unsigned int              bonus_units,
-           struct attack_result*     result
-          )
+Session (void)
 {
-    struct territory_def* territory_cursor;
-    struct territory_def* territory_vector;
-    unsigned int          units_on_front;
-    unsigned int          remaining_units_on_front;
-    unsigned int          remaining_territory_units;
-
-    units_on_front   = attack_vector->units_on_front+bonus_units;
-    territory_vector = attack_vector->territory_vector;
+    struct war_session session;
+    struct line_reader reader;
+    char*              line;
 
-    territory_cursor = territory_vector;
+    memset(&session, 0, sizeof(session));
+    InitArena(&session.arena);
+    InitArena(&session.spare_arena);
+    InitLineReader(&reader, STDIN_FILENO);
 
-    for(unsigned int size = attack_vector->territory_count; size-- > 0;)
+    while((line = ReadLine(&reader, stdout)) != NULL)
     {
-        Debug(
-              "Attacking %u vs %u\n"
-              "------------------\n",
-              units_on_front,
-              territory_cursor->units
-             );
-
-        AttackTerritory(
-                        units_on_front,
-                        territory_cursor,
-                        &remaining_units_on_front,
-                        &remaining_territory_units
-                       );
+        char**   args;
+        char*    error;
+        size_t   first_row;
+        size_t   row_count;
+        size_t   evaluated_count;
+        uint64_t total_trials;
+        int      arg_count;
+
+        ResetArena(&run_arena);
+
+        args = SplitQueryArgs(&run_arena, ArenaCopyString(&run_arena, line), &arg_count);
+        if(arg_count == 0)
+            continue;
 
-        Debug("\n");
+        if(strcmp(args[0], "quit") == 0)
+            break;
 
-        if(remaining_territory_units == 0)
-            units_on_front = remaining_units_on_front-MIN_TERRITORY_UNITS;
+        /* A full query predicts every row, an edit only the row of the vector it touched */
+        if(strcmp(args[0], "set") == 0 || strcmp(args[0], "add") == 0 || strcmp(args[0], "remove") == 0)
+            error = EditSession(&session, arg_count, args, &first_row, &row_count);
         else
         {
-            units_on_front = remaining_units_on_front;
+            error     = StartSession(&session, line);
+            first_row = 0;
+            row_count = session.query.attack_vector_count;
+        }
 
-            Debug(
-                  "Attack failed with %u vs %u remaining\n\n",
-                  units_on_front,
-                  remaining_territory_units
-                 );
+        if(error != NULL)
+        {
+            printf("error %s\n", error);
 
-            break;
+            continue;
         }
 
-        territory_cursor++;
+        run_seed = MixSeed(run_seed);
+
+        evaluated_count = 0;
+
+        EnterPhase(phase_predict);
+
+        total_trials = PredictSessionRows(&session, first_row, row_count, &evaluated_count);
+
+        ReportPlans(
+                    session.setups,
+                    session.query.attack_vector_count,
+                    session.query.bonus_units,
+                    session.query.likelihood_threshold,
+                    session.query.sim_iterations,
+                    session.pending_setups,
+                    total_trials,
+                    evaluated_count,
+                    stdout
+                   );
+
+        LeavePhase();
     }
 
-    result->conquered_territory_count = territory_cursor-territory_vector;
-    result->units_on_front            = units_on_front;
-    result->enemy_units_on_front      = remaining_territory_units;
+    fflush(stdout);
+    free(reader.buffer);
+    free(session.pending_setups);
+    free(session.setups);
+    free(session.query.attack_vectors);
+    FreeArena(&session.spare_arena);
+    FreeArena(&session.arena);
 }
 
-static inline void
-PredictAttack (
-               struct attack_vector_def* attack_vector,
-               unsigned int              bonus_units,
-               unsigned int              sim_iterations,
-               struct attack_prediction* prediction
-              )
+static inline size_t
+BatchLineEnd (char* mapping, size_t mapping_size, size_t offset)
 {
-    unsigned int win_count;
-    unsigned int total_units_on_front;
-    unsigned int loss_count;
-    unsigned int total_enemy_units_remaining;
-    unsigned int total_territories_remaining;
+    char* newline;
 
-    win_count                   = 0;
-    total_units_on_front        = 0;
-    loss_count                  = 0;
-    total_enemy_units_remaining = 0;
-    total_territories_remaining = 0;
+    if(offset >= mapping_size)
+        return mapping_size;
 
-    for(size_t remaining = sim_iterations; remaining-- > 0;)
-    {
-        struct attack_result result;
+    newline = memchr(&mapping[offset], '\n', mapping_size-offset);
+
+    return newline != NULL ? (size_t)(newline-mapping)+1 : mapping_size;
+}
+
+static void
+ParseBatchRange (void* context, size_t task_index, struct sim_context* sim)
+{
+    struct batch_range* range;
+    size_t              line_count;
+    char*               cursor;
+
+    (void)sim;
 
-        Debug(
-              "Beginning simulation of attack vector '%s'\n"
-              "------------------------------------------\n",
-              attack_vector->def_string
-             );
+    range = &((struct batch_range*)context)[task_index];
 
-        SimAttack(attack_vector, bonus_units, &result);
+    line_count = 1;
+    for(cursor = range->begin; (cursor = memchr(cursor, '\n', range->end-cursor)) != NULL; cursor++)
+        line_count++;
 
-        if(result.enemy_units_on_front == 0)
+    range->queries     = ArenaAlloc(&range->arena, line_count*sizeof(struct batch_query));
+    range->query_count = 0;
+    range->quit        = 0;
+
+    for(cursor = range->begin; cursor < range->end;)
+    {
+        struct batch_query* query;
+        char**              args;
+        char*               line;
+        char*               newline;
+        int                 arg_count;
+
+        /* Lines are split in the private mapping, only the file's unterminated last line is copied */
+        line    = cursor;
+        newline = memchr(cursor, '\n', range->end-cursor);
+        if(newline != NULL)
         {
-            win_count++;
-            total_units_on_front += result.units_on_front;
+            *newline = '\0';
+            cursor   = newline+1;
         }
         else
         {
-            struct territory_def* territories;
-            unsigned int          enemy_units_remaining;
-            unsigned int          territory_count;
+            line = ArenaAlloc(&range->arena, (size_t)(range->end-cursor)+1);
+            memcpy(line, cursor, (size_t)(range->end-cursor));
+            line[range->end-cursor] = '\0';
 
-            territories           = attack_vector->territory_vector;
-            territory_count       = attack_vector->territory_count;
-            enemy_units_remaining = result.enemy_units_on_front;
+            cursor = range->end;
+        }
 
-            for(
-                unsigned int index = result.conquered_territory_count+1;
-                index < territory_count;
-                index++
-               )
-            {
-                enemy_units_remaining += territories[index].units;
-            }
+        args = SplitQueryArgs(&range->arena, line, &arg_count);
+        if(arg_count == 0)
+            continue;
 
-            loss_count++;
-            total_enemy_units_remaining += enemy_units_remaining;
-            total_territories_remaining += territory_count-result.conquered_territory_count;
+        if(strcmp(args[0], "quit") == 0)
+        {
+            range->quit = 1;
+
+            break;
         }
-    }
 
-    prediction->win_likelihood                          = (float)win_count/(float)(win_count+loss_count);
-    prediction->estimated_remaining_units_if_win        = (float)total_units_on_front/(float)win_count;
-    prediction->estimated_remaining_enemies_if_loss     = (float)total_enemy_units_remaining/(float)loss_count;
-    prediction->estimated_remaining_territories_if_loss = (float)total_territories_remaining/(float)loss_count;
-    prediction->win_count                               = win_count;
-    prediction->loss_count                              = loss_count;
+        query        = &range->queries[range->query_count++];
+        query->error = ParseQuery(&range->arena, arg_count, args, &query->query);
+    }
 }
 
 static inline void
-SimWar (
-        struct attack_vector_def* attack_vectors,
-        size_t                    count,
-        unsigned int              bonus_units,
-        unsigned int              sim_iterations
-       )
+RunBatch (void)
 {
-    for(size_t index = 0; index < count; index++)
+    struct batch_range* ranges;
+    struct stat         file_stat;
+    FILE*               result_stream;
+    char*               mapping;
+    size_t              mapping_size;
+    size_t              range_count;
+    size_t              offset;
+    int                 quit;
+    int                 fd;
+
+    fd = open(run_batch_path, O_RDONLY);
+    if(fd < 0)
+        Abort("Failed to open batch file");
+
+    if(fstat(fd, &file_stat) != 0)
+        Abort("Failed to stat batch file");
+
+    mapping_size = (size_t)file_stat.st_size;
+    mapping      = NULL;
+
+    /* A private mapping lets lines be split in place without ever writing back to the file */
+    if(mapping_size > 0)
     {
-        struct attack_prediction  prediction;
-        struct attack_vector_def* attack_vector;
+        mapping = mmap(NULL, mapping_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(mapping == MAP_FAILED)
+            Abort("Failed to map batch file");
 
-        attack_vector = &attack_vectors[index];
+        posix_madvise(mapping, mapping_size, POSIX_MADV_SEQUENTIAL);
+    }
 
-        PredictAttack(attack_vector, bonus_units, sim_iterations, &prediction);
+    close(fd);
 
-        printf("\n");
-        PrintPrediction(attack_vector->def_string, &prediction);
+    result_stream = stdout;
+    if(run_batch_output != NULL)
+    {
+        result_stream = fopen(run_batch_output, "w");
+        if(result_stream == NULL)
+            Abort("Failed to open batch output file");
     }
-}
 
-static inline void
-InitCombinations (unsigned int* indices, size_t index_count)
-{
-    for(size_t index = index_count; index-- > 0;)
-        indices[index] = 0;
-}
+    range_count = run_pool.worker_count*BATCH_RANGES_PER_WORKER;
 
-static inline enum combinations_state
-NextCombination (unsigned int* indices, size_t index_count, unsigned int last_index)
-{
-    size_t index;
+    ranges = calloc(range_count, sizeof(struct batch_range));
+    if(ranges == NULL)
+        Abort("Failed to alloc memory for batch ranges");
 
-    index = 0;
+    for(size_t index = 0; index < range_count; index++)
+        InitArena(&ranges[index].arena);
 
-    do
+    /*
+     The file is consumed a segment at a time.  Each segment is cut into line aligned ranges by
+     offset, the workers parse the ranges in parallel, and then the queries are run, each on
+     the whole pool, in file order so results line up with their queries.
+     */
+    quit = 0;
+
+    for(offset = 0; offset < mapping_size && !quit;)
     {
-        indices[index]++;
-        if(indices[index] <= last_index)
-            return combinations_remain;
+        size_t segment_end;
+        size_t segment_size;
+        size_t range_begin;
 
-        indices[index] = 0;
+        segment_end  = BatchLineEnd(mapping, mapping_size, offset+BATCH_SEGMENT_SIZE-1);
+        segment_size = segment_end-offset;
 
-        index++;
-    }while(index < index_count);
+        range_begin = offset;
 
-    return combinations_exhausted;
-}
+        for(size_t index = 0; index < range_count; index++)
+        {
+            size_t split;
+            size_t range_end;
 
-static inline void
-PlanWar (
-         struct attack_vector_def* attack_vectors,
-         size_t                    attack_vector_count,
-         unsigned int              bonus_units,
-         float                     likelihood_threshold,
-         unsigned int              sim_iterations
-        )
-{
-    struct attack_setup setups[attack_vector_count][bonus_units+1];
-    unsigned int        bonus_indices[attack_vector_count];
-    struct attack_plan* plans;
-    struct attack_plan* cursor;
-    size_t              plans_size;
-    size_t              plans_count;
-
-    plans_count = 0;
-    plans_size  = PLANS_SIZE_INCREMENT;
-    plans       = malloc(plans_size*sizeof(struct attack_plan));
-    if(plans == NULL)
-        Abort("Memory alloc for plans failed");
+            /* A range ends with the line holding its even split point, so ranges may be empty */
+            split     = offset+(segment_size*(index+1))/range_count;
+            range_end = split > range_begin ? BatchLineEnd(mapping, segment_end, split-1) : range_begin;
 
-    for(size_t index = 0; index < attack_vector_count; index++)
-    {
-        struct attack_vector_def* attack_vector;
+            ResetArena(&ranges[index].arena);
+
+            ranges[index].begin = &mapping[range_begin];
+            ranges[index].end   = &mapping[range_end];
+
+            range_begin = range_end;
+        }
 
-        attack_vector = &attack_vectors[index];
-        for(unsigned int bonus = 0; bonus <= bonus_units; bonus++)
+        EnterPhase(phase_setup);
+
+        RunTasks(&run_pool, range_count, &ParseBatchRange, ranges);
+
+        LeavePhase();
+
+        for(size_t index = 0; index < range_count && !quit; index++)
         {
-            struct attack_setup* setup;
-            float                win_likelihood;
+            struct batch_range* range;
+
+            range = &ranges[index];
 
-            setup = &setups[index][bonus];
+            for(size_t query_index = 0; query_index < range->query_count; query_index++)
+            {
+                struct batch_query* query;
 
-            setup->attack_vector = attack_vector;
-            setup->bonus         = bonus;
+                query = &range->queries[query_index];
 
-            PredictAttack(
-                          attack_vector,
-                          bonus,
-                          sim_iterations,
-                          &setup->prediction
-                         );
+                if(query->error != NULL)
+                {
+                    fprintf(result_stream, "error %s\n", query->error);
 
-            win_likelihood = setup->prediction.win_likelihood;
+                    continue;
+                }
 
-            if(win_likelihood >= likelihood_threshold)
-                setup->score = win_likelihood;
-            else
-                setup->score = 0;
+                run_seed = MixSeed(run_seed);
+
+                RunWar(&query->query, result_stream);
+            }
+
+            quit = range->quit;
         }
+
+        offset = segment_end;
     }
 
-    InitCombinations(bonus_indices, attack_vector_count);
+    for(size_t index = 0; index < range_count; index++)
+        FreeArena(&ranges[index].arena);
 
-    cursor = plans;
+    free(ranges);
 
-    do
-    {
-        unsigned int total_bonus;
+    if(result_stream != stdout)
+        fclose(result_stream);
+    else
+        fflush(result_stream);
 
-        total_bonus = 0;
+    if(mapping != NULL)
+        munmap(mapping, mapping_size);
+}
 
-        cursor->total_score = 0;
-        cursor->setup_count = attack_vector_count;
+static inline char*
+OptionValue (int arg_count, char** args, int* arg_index)
+{
+    (*arg_index)++;
+    if(*arg_index >= arg_count)
+        Abort("Option is missing its value, see usage");
 
-        for(size_t index = attack_vector_count; index-- > 0;)
-        {
-            struct attack_setup* setup;
-            unsigned int         bonus;
+    return args[*arg_index];
+}
 
-            bonus = bonus_indices[index];
-            setup = &setups[index][bonus];
+static inline int
+ParseOptions (int arg_count, char** args)
+{
+    int arg_index;
 
-            total_bonus += bonus;
+    for(arg_index = 1; arg_index < arg_count; arg_index++)
+    {
+        char* option;
 
-            cursor->setups[index]  = setup;
-            cursor->total_score   += setup->score;
-        }
+        option = args[arg_index];
+        if(strncmp(option, "--", 2) != 0)
+            break;
 
-        if(total_bonus != bonus_units)
-            continue;
+        if(strcmp(option, "--exact") == 0)
+            run_flags |= enable_exact_engine;
+        else if(strcmp(option, "--curve") == 0)
+            run_flags |= enable_curve|enable_exact_engine;
+        else if(strcmp(option, "--dice") == 0)
+            run_flags |= enable_dice_rolls;
+        else if(strcmp(option, "--scalar") == 0)
+            run_flags |= enable_scalar_trials;
+        else if(strcmp(option, "--rules") == 0)
+            SelectRuleset(OptionValue(arg_count, args, &arg_index));
+        else if(strcmp(option, "--threads") == 0)
+        {
+            run_thread_count = (unsigned int)atoi(OptionValue(arg_count, args, &arg_index));
+            if(run_thread_count == 0)
+                Abort("Thread count must be at least 1");
+        }
+        else if(strcmp(option, "--exhaustive") == 0)
+            run_flags |= enable_exhaustive;
+        else if(strcmp(option, "--monotone") == 0)
+            run_flags |= enable_monotone;
+        else if(strcmp(option, "--memo") == 0)
+        {
+            run_memo_megabytes = (size_t)atoi(OptionValue(arg_count, args, &arg_index));
+            if(run_memo_megabytes == 0)
+                Abort("Battle memo needs at least one megabyte");
 
-        plans_count++;
-        if(plans_count >= plans_size)
+            run_flags |= enable_battle_memo;
+        }
+        else if(strcmp(option, "--serve") == 0)
+            run_flags |= enable_serve;
+        else if(strcmp(option, "--socket") == 0)
+        {
+            run_serve_socket  = OptionValue(arg_count, args, &arg_index);
+            run_flags        |= enable_serve;
+        }
+        else if(strcmp(option, "--session") == 0)
+            run_flags |= enable_session;
+        else if(strcmp(option, "--batch") == 0)
         {
-            plans_size += PLANS_SIZE_INCREMENT;
-            plans       = realloc(plans, plans_size*sizeof(struct attack_plan));
-            if(plans == NULL)
-                Abort("Error reallocing space for attack plans");
+            run_batch_path  = OptionValue(arg_count, args, &arg_index);
+            run_flags      |= enable_batch;
         }
+        else if(strcmp(option, "--shard") == 0)
+        {
+            char* value;
+            char* end;
 
-        cursor = &plans[plans_count];
-    }while(NextCombination(bonus_indices, attack_vector_count, bonus_units) == combinations_remain);
+            value           = OptionValue(arg_count, args, &arg_index);
+            run_shard_index = (unsigned int)strtoul(value, &end, 10);
+            if(end == value || *end != '/')
+                Abort("Shard must be given as index/count, see usage");
 
-    qsort(plans, plans_count, sizeof(struct attack_plan), &ComparePlan);
+            value           = end+1;
+            run_shard_count = (unsigned int)strtoul(value, &end, 10);
+            if(end == value || *end != '\0' || run_shard_index >= run_shard_count)
+                Abort("Shard must be given as index/count with the index below the count");
 
-    printf("Highest scoring setup is below\n");
+            run_flags |= enable_shard;
+        }
+        else if(strcmp(option, "--merge") == 0)
+            run_flags |= enable_merge;
+        else if(strcmp(option, "--table") == 0)
+        {
+            run_table_path  = OptionValue(arg_count, args, &arg_index);
+            run_flags      |= enable_battle_table;
+        }
+        else if(strcmp(option, "--output") == 0)
+            run_batch_output = OptionValue(arg_count, args, &arg_index);
+        else if(strcmp(option, "--trace") == 0)
+        {
+            run_trace_path  = OptionValue(arg_count, args, &arg_index);
+            run_flags      |= enable_tracing;
+        }
+        else if(strcmp(option, "--common-random") == 0)
+            run_flags |= enable_common_random;
+        else if(strcmp(option, "--antithetic") == 0)
+            run_flags |= enable_antithetic;
+        else if(strcmp(option, "--control") == 0)
+            run_flags |= enable_control;
+        else if(strcmp(option, "--fast-forward") == 0)
+            run_flags |= enable_fast_forward;
+        else if(strcmp(option, "--stats") == 0)
+            run_flags |= enable_stats;
+        else if(strcmp(option, "--top") == 0)
+        {
+            run_top_plans = (unsigned int)atoi(OptionValue(arg_count, args, &arg_index));
+            if(run_top_plans == 0)
+                Abort("At least one plan must be reported");
+        }
+        else if(strcmp(option, "--precision") == 0)
+        {
+            run_precision = atof(OptionValue(arg_count, args, &arg_index));
+            if(run_precision <= 0)
+                Abort("Precision must be positive");
+        }
+        else if(strcmp(option, "--confidence") == 0)
+        {
+            run_confidence = atof(OptionValue(arg_count, args, &arg_index));
+            if(run_confidence <= 0 || run_confidence >= 1)
+                Abort("Confidence must lie between 0 and 1");
+        }
+        else if(strcmp(option, "--seed") == 0)
+        {
+            run_seed       = strtoull(OptionValue(arg_count, args, &arg_index), NULL, 0);
+            run_seed_given = 1;
+        }
+        else
+            Abort("Unknown option, see usage");
+    }
 
-    for(size_t index = 0; index < attack_vector_count; index++)
-        PrintSetup(plans[0].setups[index]);
+    return arg_index;
 }
 
 int
 main (int arg_count, char** args)
 {
-    struct attack_vector_def attack_vectors[MAX_ATTACK_VECTORS];
-    char*                    debug_env;
-    size_t                   attack_vector_count;
-    float                    likelihood_threshold;
-    unsigned int             sim_iterations;
-    unsigned int             bonus_units;
-
-    run_flags = 0;
+    struct war_query query;
+    char*            error;
+    int              arg_index;
+
+    run_flags        = 0;
+    run_seed         = MixSeed((uint64_t)time(NULL)^((uint64_t)getpid() << 32));
+    run_seed_given   = 0;
+    run_thread_count = 1;
+    run_top_plans    = 1;
+    run_precision    = 0;
+    run_confidence   = DEFAULT_CONFIDENCE;
+    run_serve_socket = NULL;
+    run_trace_path   = NULL;
+    run_batch_path   = NULL;
+    run_batch_output = NULL;
+    run_table_path   = NULL;
+
+    SelectRuleset(DEFAULT_DICE_RULES);
+
+    /* The old debugging switch traces every rolled die, to DEBUG_TRACE_PATH unless --trace names a file */
+    if(getenv(DEBUG_ENV_NAME) != NULL)
+    {
+#ifdef WARPLAN_TRACE
+        run_trace_path  = DEBUG_TRACE_PATH;
+        run_flags      |= enable_tracing|enable_dice_rolls;
+#else
+        fprintf(stderr, DEBUG_ENV_NAME " is ignored, it only traces in warplan-d and warplan-t\n");
+#endif
+    }
 
-    debug_env = getenv(DEBUG_ENV_NAME);
-    if(debug_env != NULL)
-        run_flags |= enable_debugging;
+    arg_index  = ParseOptions(arg_count, args);
+    args      += arg_index;
+    arg_count -= arg_index;
 
-    if(arg_count <= program_arg_attack_vector)
+    if(run_flags&enable_merge ? arg_count < 1 : !(run_flags&(enable_serve|enable_batch|enable_session)) && arg_count <= program_arg_attack_vector)
         goto print_usage;
 
-    sim_iterations       = (unsigned int)atoi(args[program_arg_sim_iterations]);
-    bonus_units          = (unsigned int)atoi(args[program_arg_bonus_units]);
-    likelihood_threshold = (float)atof(args[program_arg_likelihood_threshold]);
+    /* Shards must predict the same cells in the same order, which rules out any adaptive sampling */
+    if(run_flags&(enable_shard|enable_merge))
+    {
+        if(run_flags&(enable_exact_engine|enable_monotone|enable_serve|enable_batch|enable_session) || run_precision > 0)
+            Abort("Shards only split fixed size simulations, not --exact, --monotone, --precision, --serve, --batch or --session");
+
+        if((run_flags&enable_shard) && (run_flags&enable_merge))
+            Abort("A run either simulates a shard or merges shards");
+
+        if(run_flags&enable_shard && run_batch_output == NULL)
+            Abort("--shard needs --output for its partial results");
+
+        /* The default seed differs from process to process, so shards could never be merged */
+        if(run_flags&enable_shard && !run_seed_given)
+            Abort("--shard needs the same --seed on every shard");
+    }
+
+    if((run_flags&enable_curve) && (run_flags&enable_monotone))
+        Abort("--curve predicts every bonus level in one sweep, leaving --monotone nothing to skip");
 
-    attack_vector_count = 0;
-    for(size_t index = program_arg_attack_vector; index < arg_count; index++)
+    if((run_flags&enable_session) && (run_flags&(enable_serve|enable_batch)))
+        Abort("A session reads its own commands from stdin, it cannot also --serve or --batch");
+
+    EnterPhase(phase_setup);
+
+    run_confidence_z = ConfidenceZScore(run_confidence);
+
+    InitRollOutcomes();
+    InitThreadPool(&run_pool, run_thread_count);
+    InitArena(&run_arena);
+
+    if(run_flags&enable_fast_forward)
+        InitFastForward();
+
+    if(run_flags&enable_tracing)
     {
-        ParseAttackVector(args[index], &attack_vectors[attack_vector_count]);
-        attack_vector_count++;
+#ifdef WARPLAN_TRACE
+        InitTrace(&run_pool, run_trace_path);
+#else
+        Abort("Tracing is compiled out of this build, use warplan-d or warplan-t");
+#endif
     }
 
-    if(bonus_units == 0)
+    if(run_flags&enable_battle_memo)
+        InitBattleMemo(&run_memo, run_memo_megabytes*1024*1024);
+
+    if(run_flags&enable_battle_table)
+        LoadBattleTable(&run_table, run_table_path);
+
+    LeavePhase();
+
+    if(run_flags&enable_batch)
+        RunBatch();
+    else if(run_flags&enable_serve)
+        Serve();
+    else if(run_flags&enable_session)
+        Session();
+    else if(run_flags&enable_merge)
     {
-        printf("Simulating simple war and printing predictions\n\n");
+        char** query_args;
+        int    query_arg_count;
 
-        SimWar(attack_vectors, attack_vector_count, bonus_units, sim_iterations);
+        query_args = SplitQueryArgs(&run_arena, LoadShards(&run_arena, arg_count, args), &query_arg_count);
+
+        error = ParseQuery(&run_arena, query_arg_count, query_args, &query);
+        if(error != NULL)
+            Abort(error);
+
+        RunWar(&query, NULL);
+
+        CloseShards();
     }
     else
     {
-        printf("Attempting to plan war for specified vectors\n\n");
+        error = ParseQuery(&run_arena, arg_count, args, &query);
+        if(error != NULL)
+            Abort(error);
 
-        PlanWar(
-                attack_vectors,
-                attack_vector_count,
-                bonus_units,
-                likelihood_threshold,
-                sim_iterations
-               );
+        if(run_flags&enable_shard)
+            BeginShard(run_batch_output, arg_count, args);
+
+        RunWar(&query, NULL);
+
+        if(run_flags&enable_shard)
+            FinishShard();
+    }
+
+    if(run_flags&enable_battle_memo)
+    {
+        PrintBattleMemoStats(run_flags&(enable_serve|enable_batch|enable_session) ? stderr : stdout, &run_memo);
+        DestroyBattleMemo(&run_memo);
     }
 
+    if(run_flags&enable_stats)
+        PrintRunStats(run_flags&(enable_serve|enable_batch|enable_session) ? stderr : stdout);
+
+#ifdef WARPLAN_TRACE
+    if(run_flags&enable_tracing)
+        FinishTrace(&run_pool);
+#endif
+
+    if(run_flags&enable_battle_table)
+        UnloadBattleTable(&run_table);
+
+    FreeArena(&run_arena);
+
+    DestroyThreadPool(&run_pool);
+
     return EXIT_SUCCESS;
 
 print_usage:
     printf(
-           "Usage: warplan [simulation iterations] [bonus units] [win threshold] [attack vectors]\n"
+           "Usage: warplan [options] [simulation iterations] [bonus units] [win threshold] [attack vectors]\n"
+           "       warplan [options] --merge [shard files]\n"
+           "\n"
+           "Options:\n"
+           "\t--exact\tCompute exact predictions instead of simulating, iterations are ignored\n"
+           "\t--curve\tPredict every bonus level of a vector exactly in one sweep and print its win likelihood curve\n"
+           "\t--dice\tSimulate by rolling individual dice rather than sampling roll outcomes\n"
+           "\t--scalar\tSimulate one trial at a time rather than a vector of trials\n"
+           "\t--rules [rules]\tPlay by the given dice rules, " DEFAULT_DICE_RULES " by default, see below\n"
+           "\t--threads [count]\tSpread predictions across the given number of threads\n"
+           "\t--seed [seed]\tSeed the random streams so runs are reproducible\n"
+           "\t--top [count]\tReport the given number of highest scoring plans\n"
+           "\t--precision [width]\tStop sampling a prediction once its win likelihood interval is this narrow\n"
+           "\t--confidence [level]\tConfidence level of the --precision interval, 0.95 by default\n"
+           "\t--exhaustive\tPlan by enumerating every allocation of bonus units\n"
+           "\t--monotone\tOnly predict the bonus levels where a vector's score can still change\n"
+           "\t--memo [megabytes]\tSample whole territory battles from a memo of exact outcome distributions\n"
+           "\t--serve\tAnswer one query per line of stdin, each formatted like the command line arguments\n"
+           "\t--socket [path]\tServe queries to connections on the given Unix socket instead of stdin\n"
+           "\t--session\tKeep a what-if session on stdin, a query followed by edits to its attack vectors\n"
+           "\t--batch [path]\tAnswer every query line of the given file, like --serve, in file order\n"
+           "\t--output [path]\tWrite --batch results to the given file instead of stdout, or --shard tallies to it\n"
+           "\t--shard [i/n]\tSimulate only the i-th of n disjoint slices of every prediction's trials\n"
+           "\t--merge\tPredict and plan from the shard files given in place of the query\n"
+           "\t--stats\tPrint work counters and time spent per phase after the run\n"
+           "\t--table [path]\tAnswer vectors within the given warplan-gentable battle table from it instead of simulating\n"
+           "\t--common-random\tDraw every prediction from the same random streams, sharpening comparisons between them\n"
+           "\t--antithetic\tPair every chunk of trials with one drawing the mirror image of its random numbers\n"
+           "\t--control\tCorrect win likelihoods by their regression on attacking losses beyond expectation\n"
+           "\t--fast-forward\tSample many full strength rounds of large battles in a single step\n"
+           "\t--trace [path]\tRecord every trial into per-thread rings in the given file, warplan-d and warplan-t only\n"
            "\n"
            "Attack vectors are formatted as: "
            "[units on front]:[enemy territory 1 units],[enemy territory n units]\n"
+           "Branches follow the last territory in brackets, each attacked from it: 10:3[2,99][4]\n"
+           "\n"
+           "Dice rules are formatted as: [attack dice]v[defend dice]d[dice sides], followed by l[units] when\n"
+           "more than 1 unit must stay behind on a territory, and may be:" DICE_RULESETS(RULESET_NAME) "\n"
            "\n"
            "Examples:\n\n"
            "\tJust simulate a single attack vector, no planning:\n"
@@ -748,8 +6306,20 @@ print_usage:
            "\tSimulate multiple attack vectors, no planning:\n"
            "\t\twarplan 1000 0 0 7:1,1,2 4:5,1\n"
            "\n"
+           "\tSimulate an attack that forks after its first territory:\n"
+           "\t\twarplan 1000 0 0 10:3[2,99][4]\n"
+           "\n"
            "\tGiven 10 bonus armies, plan an attack across multiple vectors requiring a win likelihood of 0.8:\n"
            "\t\twarplan 1000 10 0.8 3:2,2 4:1,1,1,1 2:2,1,2\n"
+           "\n"
+           "\tPlan the same attack using exact predictions:\n"
+           "\t\twarplan --exact 0 10 0.8 3:2,2 4:1,1,1,1 2:2,1,2\n"
+           "\n"
+           "\tPlan it from one exact sweep per vector, printing each vector's win likelihood curve:\n"
+           "\t\twarplan --curve 0 10 0.8 3:2,2 4:1,1,1,1 2:2,1,2\n"
+           "\n"
+           "\tPlan it with 3 defending dice, 8 sided dice and 2 units left behind on every territory:\n"
+           "\t\twarplan --rules 3v3d8l2 1000 10 0.8 3:2,2 4:1,1,1,1 2:2,1,2\n"
           );
 
     return EXIT_FAILURE;
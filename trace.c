@@ -0,0 +1,174 @@
+/*
+ WarPlan trace decoder.
+
+ Reads a trace file written by a WARPLAN_TRACE build, warplan-d or warplan-t, and prints every
+ record still held in each worker's ring, oldest first.  Rings wrap, so a long run only keeps its
+ most recent TRACE_RING_RECORDS records per worker and the count of records dropped is printed up
+ front.
+
+ Usage:
+     ./warplan-trace [trace file]
+ */
+
+
+#define main WarPlanMain
+#include "main.c"
+#undef main
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+static inline void
+PrintDice (uint32_t packed, unsigned int first_die, unsigned int die_count)
+{
+    char* separator;
+
+    separator = "";
+
+    printf("[");
+
+    for(unsigned int index = first_die; index < first_die+die_count; index++)
+    {
+        unsigned int die;
+
+        die = (packed >> (index*DICE_BITS))&((1 << DICE_BITS)-1);
+        if(die == 0)
+            break;
+
+        printf("%s%u", separator, die);
+        separator = ", ";
+    }
+
+    printf("]");
+}
+
+static inline void
+PrintTraceRecord (struct trace_record* record)
+{
+    switch(record->event)
+    {
+        case trace_chunk:
+            printf("Chunk %u of prediction cell %u\n", record->values[1], record->values[0]);
+            break;
+
+        case trace_trial:
+            printf("  Trial of %u front units against %u territories\n", record->values[0], record->values[1]);
+            break;
+
+        case trace_territory:
+            printf("    Attacking %u vs %u\n", record->values[0], record->values[1]);
+            break;
+
+        case trace_dice:
+            printf("      %u ", record->values[0]);
+            PrintDice(record->detail, 0, MAX_ATTACK_DICE_COUNT);
+            printf(" vs %u ", record->values[1]);
+            PrintDice(record->detail, MAX_ATTACK_DICE_COUNT, MAX_DEFEND_DICE_COUNT);
+            printf("\n");
+            break;
+
+        case trace_losses:
+            printf(
+                   "      %u front units lost and %u defending units lost\n",
+                   record->values[0],
+                   record->values[1]
+                  );
+            break;
+
+        case trace_battle:
+            printf("      Battle sampled from memo, %u vs %u remaining\n", record->values[0], record->values[1]);
+            break;
+
+        case trace_conquered:
+            printf(
+                   "    Conquered territory %u, moving %u units forward\n",
+                   record->values[0]+1,
+                   record->values[1]
+                  );
+            break;
+
+        case trace_failed:
+            printf("    Attack failed with %u vs %u remaining\n", record->values[0], record->values[1]);
+            break;
+
+        case trace_fast_forward:
+            printf(
+                   "      Fast forward %u rounds, %u front units lost and %u defending units lost\n",
+                   record->detail,
+                   record->values[0],
+                   record->values[1]
+                  );
+            break;
+
+        default:
+            printf("Unknown trace event %u\n", record->event);
+            break;
+    }
+}
+
+int
+main (int arg_count, char** args)
+{
+    struct trace_file_header* header;
+    struct stat               file_stat;
+    size_t                    ring_size;
+    char*                     rings;
+    void*                     mapping;
+    int                       fd;
+
+    if(arg_count != 2)
+    {
+        printf("Usage: warplan-trace [trace file]\n");
+
+        return EXIT_FAILURE;
+    }
+
+    fd = open(args[1], O_RDONLY);
+    if(fd < 0)
+        Abort("Failed to open trace file");
+
+    if(fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(struct trace_file_header))
+        Abort("Trace file is too small");
+
+    mapping = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping == MAP_FAILED)
+        Abort("Failed to map trace file");
+
+    close(fd);
+
+    header = mapping;
+    if(memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0)
+        Abort("Not a WarPlan trace file");
+
+    ring_size = sizeof(struct trace_ring)+(size_t)header->ring_capacity*sizeof(struct trace_record);
+    if(sizeof(struct trace_file_header)+header->worker_count*ring_size > (size_t)file_stat.st_size)
+        Abort("Trace file is truncated");
+
+    rings = (char*)&header[1];
+
+    for(unsigned int worker = 0; worker < header->worker_count; worker++)
+    {
+        struct trace_ring* ring;
+        uint64_t           first_record;
+
+        ring         = (struct trace_ring*)&rings[worker*ring_size];
+        first_record = ring->record_count > ring->capacity ? ring->record_count-ring->capacity : 0;
+
+        printf(
+               "%sWorker %u, %llu records, %llu dropped\n",
+               worker > 0 ? "\n" : "",
+               worker,
+               (unsigned long long)ring->record_count,
+               (unsigned long long)first_record
+              );
+
+        for(uint64_t index = first_record; index < ring->record_count; index++)
+            PrintTraceRecord(&ring->records[index&(ring->capacity-1)]);
+    }
+
+    munmap(mapping, (size_t)file_stat.st_size);
+
+    return EXIT_SUCCESS;
+}